@@ -3,14 +3,16 @@
 #include <vector>
 
 extern "C" {
+#include <dlfcn.h>
 #include <execinfo.h>
 #include <cxxabi.h>
 #include <stdlib.h>
 #include <sys/types.h>
 }
 
-#include <string>
+#include <algorithm>
 #include <array>
+#include <string>
 
 namespace utils {
 
@@ -70,4 +72,40 @@ std::vector<std::string> getBacktrace() {
     return result;
 }
 
+size_t captureBacktrace(void** buffer, size_t size) {
+    auto backtraceSize = ::backtrace(buffer, static_cast<int>(size));
+    if (backtraceSize <= 1) {
+        return 0;
+    }
+    // Skipping the 0-th, which is this function.
+    std::copy(buffer + 1, buffer + backtraceSize, buffer);
+    return backtraceSize - 1;
+}
+
+std::string symbolize(void* pc) {
+    Dl_info info {};
+    if (::dladdr(pc, &info) == 0) {
+        std::array<char, 32> address;
+        snprintf(address.data(), address.size(), "%p", pc);
+        return address.data();
+    }
+    if (info.dli_sname != nullptr) {
+        int status = 0;
+        char* realname = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string result = status == 0 ? realname : info.dli_sname;
+        free(realname);
+        return result;
+    }
+    // Static function or stripped binary, use the offset in module instead.
+    std::string result = info.dli_fname != nullptr ? info.dli_fname : "??";
+    if (auto slash = result.rfind('/'); slash != std::string::npos) {
+        result.erase(0, slash + 1);
+    }
+    std::array<char, 32> offset;
+    snprintf(offset.data(), offset.size(), "+0x%zx"
+            , static_cast<size_t>(static_cast<char*>(pc) - static_cast<char*>(info.dli_fbase)));
+    result.append(offset.data());
+    return result;
+}
+
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -9,4 +11,11 @@ constexpr uint32_t MAX_BACKTRACE_DEPTH = 16;
 
 std::vector<std::string> getBacktrace();
 
+// Capture at most size - 1 raw return addresses of current stack, frame 0 is the caller of captureBacktrace.
+// Async-signal-safety after the first call, which loads the unwinder.
+size_t captureBacktrace(void** buffer, size_t size);
+
+// Return demangled function name of pc, or "module+0xoffset" if the symbol isn't exported.
+std::string symbolize(void* pc);
+
 }
@@ -0,0 +1,199 @@
+#include "Encode.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+#include <immintrin.h>
+#endif
+
+namespace utils {
+
+namespace detail {
+
+static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+static constexpr char BASE64_DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+size_t hexEncodeScalar(const uint8_t* src, size_t size, char* dst) {
+    for (size_t i = 0; i < size; ++i) {
+        dst[2 * i] = HEX_DIGITS[src[i] >> 4];
+        dst[2 * i + 1] = HEX_DIGITS[src[i] & 0x0f];
+    }
+    return hexEncodedSize(size);
+}
+
+size_t base64EncodeScalar(const uint8_t* src, size_t size, char* dst) {
+    char* out = dst;
+    size_t i = 0;
+    for (; i + 3 <= size; i += 3) {
+        uint32_t value = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+        *out++ = BASE64_DIGITS[(value >> 18) & 0x3f];
+        *out++ = BASE64_DIGITS[(value >> 12) & 0x3f];
+        *out++ = BASE64_DIGITS[(value >> 6) & 0x3f];
+        *out++ = BASE64_DIGITS[value & 0x3f];
+    }
+    if (size - i == 1) {
+        uint32_t value = src[i] << 16;
+        *out++ = BASE64_DIGITS[(value >> 18) & 0x3f];
+        *out++ = BASE64_DIGITS[(value >> 12) & 0x3f];
+        *out++ = '=';
+        *out++ = '=';
+    } else if (size - i == 2) {
+        uint32_t value = (src[i] << 16) | (src[i + 1] << 8);
+        *out++ = BASE64_DIGITS[(value >> 18) & 0x3f];
+        *out++ = BASE64_DIGITS[(value >> 12) & 0x3f];
+        *out++ = BASE64_DIGITS[(value >> 6) & 0x3f];
+        *out++ = '=';
+    }
+    return out - dst;
+}
+
+#if defined (__x86_64__) || defined (__i386__)
+
+bool cpuSupportsSsse3() {
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+}
+
+bool cpuSupportsAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+__attribute__((target("ssse3")))
+size_t hexEncodeSsse3(const uint8_t* src, size_t size, char* dst) {
+    const __m128i lut = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7'
+            , '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    // 16 bytes to 32 characters in every round.
+    for (; i + 16 <= size; i += 16) {
+        __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i high = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(input, 4), mask));
+        __m128i low = _mm_shuffle_epi8(lut, _mm_and_si128(input, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+    }
+    hexEncodeScalar(src + i, size - i, dst + 2 * i);
+    return hexEncodedSize(size);
+}
+
+__attribute__((target("avx2")))
+size_t hexEncodeAvx2(const uint8_t* src, size_t size, char* dst) {
+    const __m256i lut = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7'
+            , '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+            , '0', '1', '2', '3', '4', '5', '6', '7'
+            , '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    // 32 bytes to 64 characters in every round.
+    for (; i + 32 <= size; i += 32) {
+        __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i high = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(input, 4), mask));
+        __m256i low = _mm256_shuffle_epi8(lut, _mm256_and_si256(input, mask));
+        // Unpack works in 128 bits lanes, so swap the middle two lanes back.
+        __m256i first = _mm256_unpacklo_epi8(high, low);
+        __m256i second = _mm256_unpackhi_epi8(high, low);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    // Avoid the penalty of switching from AVX to legacy SSE instructions.
+    _mm256_zeroupper();
+    hexEncodeSsse3(src + i, size - i, dst + 2 * i);
+    return hexEncodedSize(size);
+}
+
+// Translate 6 bits indices to base64 characters.
+// See http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+__attribute__((target("ssse3")))
+static inline __m128i base64LookupSsse3(__m128i indices) {
+    const __m128i shiftLut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52
+            , '0' - 52, '0' - 52, '0' - 52, '0' - 52
+            , '0' - 52, '0' - 52, '0' - 52, '+' - 62
+            , '/' - 63, 'A', 0, 0);
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    result = _mm_shuffle_epi8(shiftLut, result);
+    return _mm_add_epi8(result, indices);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i base64LookupAvx2(__m256i indices) {
+    const __m256i shiftLut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52
+            , '0' - 52, '0' - 52, '0' - 52, '0' - 52
+            , '0' - 52, '0' - 52, '0' - 52, '+' - 62
+            , '/' - 63, 'A', 0, 0
+            , 'a' - 26, '0' - 52, '0' - 52, '0' - 52
+            , '0' - 52, '0' - 52, '0' - 52, '0' - 52
+            , '0' - 52, '0' - 52, '0' - 52, '+' - 62
+            , '/' - 63, 'A', 0, 0);
+    __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    result = _mm256_shuffle_epi8(shiftLut, result);
+    return _mm256_add_epi8(result, indices);
+}
+
+__attribute__((target("ssse3")))
+size_t base64EncodeSsse3(const uint8_t* src, size_t size, char* dst) {
+    // Spread every 3 bytes to 4 bytes, and then split them to 6 bits indices.
+    const __m128i shuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    size_t i = 0;
+    size_t o = 0;
+    // 12 bytes to 16 characters in every round, but 16 bytes are loaded.
+    for (; i + 16 <= size; i += 12, o += 16) {
+        __m128i input = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), shuffle);
+        __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(input, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i t1 = _mm_mullo_epi16(_mm_and_si128(input, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + o), base64LookupSsse3(_mm_or_si128(t0, t1)));
+    }
+    return o + base64EncodeScalar(src + i, size - i, dst + o);
+}
+
+__attribute__((target("avx2")))
+size_t base64EncodeAvx2(const uint8_t* src, size_t size, char* dst) {
+    const __m256i shuffle = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1
+            , 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    size_t i = 0;
+    size_t o = 0;
+    // 24 bytes to 32 characters in every round, every 128 bits lane loads 16 bytes.
+    for (; i + 28 <= size; i += 24, o += 32) {
+        __m256i input = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)))
+                , _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 12)), 1);
+        input = _mm256_shuffle_epi8(input, shuffle);
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(input, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(input, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + o), base64LookupAvx2(_mm256_or_si256(t0, t1)));
+    }
+    _mm256_zeroupper();
+    return o + base64EncodeSsse3(src + i, size - i, dst + o);
+}
+
+#endif
+
+} // namespace detail
+
+size_t hexEncode(const uint8_t* src, size_t size, char* dst) {
+#if defined (__x86_64__) || defined (__i386__)
+    if (detail::cpuSupportsAvx2()) {
+        return detail::hexEncodeAvx2(src, size, dst);
+    }
+    if (detail::cpuSupportsSsse3()) {
+        return detail::hexEncodeSsse3(src, size, dst);
+    }
+#endif
+    return detail::hexEncodeScalar(src, size, dst);
+}
+
+size_t base64Encode(const uint8_t* src, size_t size, char* dst) {
+#if defined (__x86_64__) || defined (__i386__)
+    if (detail::cpuSupportsAvx2()) {
+        return detail::base64EncodeAvx2(src, size, dst);
+    }
+    if (detail::cpuSupportsSsse3()) {
+        return detail::base64EncodeSsse3(src, size, dst);
+    }
+#endif
+    return detail::base64EncodeScalar(src, size, dst);
+}
+
+} // namespace utils
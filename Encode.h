@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace utils {
+
+constexpr size_t hexEncodedSize(size_t size) {
+    return size * 2;
+}
+
+constexpr size_t base64EncodedSize(size_t size) {
+    return (size + 2) / 3 * 4;
+}
+
+// Encode src to lower case hex string, dst must have hexEncodedSize(size) bytes.
+// Use the fastest kernel which is supported by current CPU.
+// Return the size of encoded string.
+size_t hexEncode(const uint8_t* src, size_t size, char* dst);
+
+// Encode src to standard base64 string with padding, dst must have base64EncodedSize(size) bytes.
+// Use the fastest kernel which is supported by current CPU.
+// Return the size of encoded string.
+size_t base64Encode(const uint8_t* src, size_t size, char* dst);
+
+namespace detail {
+
+// All kernels produce the same output, they are exposed for test and benchmark.
+// SSE and AVX2 kernels must be called only if the CPU supports them.
+size_t hexEncodeScalar(const uint8_t* src, size_t size, char* dst);
+size_t base64EncodeScalar(const uint8_t* src, size_t size, char* dst);
+
+#if defined (__x86_64__) || defined (__i386__)
+bool cpuSupportsSsse3();
+bool cpuSupportsAvx2();
+
+size_t hexEncodeSsse3(const uint8_t* src, size_t size, char* dst);
+size_t hexEncodeAvx2(const uint8_t* src, size_t size, char* dst);
+size_t base64EncodeSsse3(const uint8_t* src, size_t size, char* dst);
+size_t base64EncodeAvx2(const uint8_t* src, size_t size, char* dst);
+#endif
+
+} // namespace detail
+
+} // namespace utils
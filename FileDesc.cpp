@@ -0,0 +1,69 @@
+#include "FileDesc.h"
+
+extern "C" {
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+}
+
+namespace utils {
+
+int FileDesc::write(std::string_view str) {
+    int result = 0;
+    do {
+        result = static_cast<int>(::write(mFd, str.data(), str.size()));
+    } while (result < 0 && errno == EINTR);
+    return result;
+}
+
+int FileDesc::writev(std::span<const iovec> buffers) {
+    int result = 0;
+    do {
+        result = static_cast<int>(::writev(mFd, buffers.data(), static_cast<int>(buffers.size())));
+    } while (result < 0 && errno == EINTR);
+    return result;
+}
+
+int FileDesc::read(uint8_t* buf, size_t size) {
+    int result = 0;
+    do {
+        result = static_cast<int>(::read(mFd, buf, size));
+    } while (result < 0 && errno == EINTR);
+    return result;
+}
+
+void FileDesc::setNoBlock() {
+    auto flags = fcntl(mFd, F_GETFL);
+    if (flags < 0 || fcntl(mFd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        throw std::system_error { errno, std::system_category(), "Can't set O_NONBLOCK"};
+    }
+}
+
+bool FileDesc::isNoBlock() {
+    auto flags = fcntl(mFd, F_GETFL);
+    if (flags < 0) {
+        throw std::system_error { errno, std::system_category(), "Can't get file status flags"};
+    }
+    return (flags & O_NONBLOCK) != 0;
+}
+
+void FileDesc::setNoDelay() {
+    int enable = 1;
+    if (setsockopt(mFd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable)) < 0) {
+        throw std::system_error { errno, std::system_category(), "Can't set TCP_NODELAY"};
+    }
+}
+
+bool FileDesc::isNoDelay() {
+    int enable = 0;
+    socklen_t length = sizeof(enable);
+    if (getsockopt(mFd, IPPROTO_TCP, TCP_NODELAY, &enable, &length) < 0) {
+        throw std::system_error { errno, std::system_category(), "Can't get TCP_NODELAY"};
+    }
+    return enable != 0;
+}
+
+} // namespace utils
@@ -10,12 +10,16 @@
 extern "C" {
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/uio.h>
 }
 namespace utils {
 
 class FileDesc {
     DISABLE_COPY(FileDesc);
 public:
+    // Take the ownership of a opened file descriptor, such as socket.
+    explicit FileDesc(int fd) : mFd(fd) {}
+
     explicit FileDesc(std::string_view path, int flags) {
         mFd = open(path.data(), flags);
         if (mFd < 0) {
@@ -23,6 +27,14 @@ public:
         }
     }
 
+    // The mode is used only when flags contains O_CREAT.
+    explicit FileDesc(std::string_view path, int flags, mode_t mode) {
+        mFd = open(path.data(), flags, mode);
+        if (mFd < 0) {
+            throw std::system_error { errno, std::system_category(), "Can't open file"};
+        }
+    }
+
     ~FileDesc() {
         if (mFd >= 0)
             close(mFd);
@@ -33,6 +45,9 @@ public:
 
     int write(std::string_view str);
 
+    // Gather write, may write partially.
+    int writev(std::span<const iovec> buffers);
+
     template <typename T>
     int write(std::span<T> buffer);
 
@@ -50,8 +65,9 @@ public:
     void setNoBlock();
     bool isNoBlock();
 
+    // Only available for TCP socket.
     void setNoDelay();
-    void isNoDelay();
+    bool isNoDelay();
 
 private:
     int mFd;
@@ -8,7 +8,15 @@
 #pragma GCC diagnostic ignored "-Wformat-security"
 #endif
 
+#include "utils.h"
+#include "LogLayout.h"
+
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
 #include <string_view>
 
 extern "C" {
@@ -34,10 +42,61 @@ class LogServer;
 // Exception should be deal with in internal module of Log.
 void format_log_line(LogLevel level, std::string_view fmt, std::string_view tag) noexcept;
 
+enum class PayloadEncoding : uint8_t {
+    Hex = 0,
+    Base64,
+};
+
+// Copy raw payload to log buffer, it would be encoded to dump lines by flush thread.
+void format_log_payload(LogLevel level, PayloadEncoding encoding, const void* data, size_t size
+        , std::string_view fmt, std::string_view tag) noexcept;
+
+// Write lines as one contiguous block, which are separated by '\n'.
+void commit_log_group(LogLevel level, std::string_view lines, std::string_view tag) noexcept;
+
 constexpr int TransLogLevelToInt(LogLevel level) {
     return static_cast<int>(level);
 }
 
+// TraceSite is the static state of one LOG_SCOPE call site.
+// The name must be a static string, because only the pointer is recorded.
+struct TraceSite {
+    constexpr explicit TraceSite(const char* siteName) : name(siteName) {}
+
+    const char*             name;
+    std::atomic<uint32_t>   counter = 0;
+    std::atomic<uint32_t>   sampleRate = 1;
+    std::atomic<uint32_t>   generation = 0;
+};
+
+// Return true if this pass of the call site should be recorded.
+bool trace_sample(TraceSite& site) noexcept;
+
+// Get the timestamp of trace span in microseconds.
+int64_t trace_now() noexcept;
+
+// Record a finished span, it would be formatted by flush thread.
+void trace_span(const char* name, int64_t beginUs, int64_t endUs) noexcept;
+
+// TraceSpan record the begin and end timestamp of current scope.
+class TraceSpan {
+    DISABLE_COPY(TraceSpan);
+    DISABLE_MOVE(TraceSpan);
+public:
+    explicit TraceSpan(TraceSite& site) noexcept
+        : mName(site.name), mBeginUs(trace_sample(site) ? trace_now() : -1) {}
+
+    ~TraceSpan() {
+        if (mBeginUs >= 0) {
+            trace_span(mName, mBeginUs, trace_now());
+        }
+    }
+
+private:
+    const char* mName;
+    int64_t     mBeginUs;
+};
+
 } // namespace detail
 
 
@@ -54,10 +113,55 @@ constexpr int TransLogLevelToInt(LogLevel level) {
 #define LOG_MAX_FILE_SIZE (1 << 20)
 #endif
 
+// Default total size of log files in log path, the oldest log file would be deleted
+// if total size exceeds this value. 0 means no limit.
+#ifndef LOG_MAX_TOTAL_SIZE
+#define LOG_MAX_TOTAL_SIZE (64ULL * LOG_MAX_FILE_SIZE)
+#endif
+// Default max age of log files in seconds, older log file would be deleted. 0 means no limit.
+#ifndef LOG_MAX_FILE_AGE
+#define LOG_MAX_FILE_AGE (7 * 24 * 3600)
+#endif
+
+// Default max size of spill file, which keeps log lines when collector is unreachable.
+#ifndef LOG_SINK_MAX_SPILL_SIZE
+#define LOG_SINK_MAX_SPILL_SIZE (64ULL * LOG_MAX_FILE_SIZE)
+#endif
+
+// Default max time in milliseconds which a log line could stay in memory before it's flushed.
+#ifndef LOG_FLUSH_MAX_LATENCY
+#define LOG_FLUSH_MAX_LATENCY 2000
+#endif
+// Default count of full log buffers which would be flushed together.
+#ifndef LOG_FLUSH_MAX_BATCH
+#define LOG_FLUSH_MAX_BATCH 4
+#endif
+
+// Default max size of payload which is logged by LOG_*_HEX and LOG_*_B64, the rest is truncated.
+#ifndef LOG_MAX_PAYLOAD_SIZE
+#define LOG_MAX_PAYLOAD_SIZE 1024
+#endif
+
+// Default layout of log line, see makeLogLayout() for the fields.
+#ifndef DEFAULT_LOG_LAYOUT
+#define DEFAULT_LOG_LAYOUT "%D %T.%u %p %t [%l][%g] %m"
+#endif
+
 #ifndef DEFAULT_LOG_LEVEL
 #define DEFAULT_LOG_LEVEL 1
 #endif
 
+// Log lines whose level is lower than this level are kept in the in-memory flight recorder
+// instead of log file, and are written as backfill when LOG_ERR/LOG_FATAL happen.
+// Default 0 means flight recorder is disabled.
+#ifndef LOG_FLIGHT_RECORDER_LEVEL
+#define LOG_FLIGHT_RECORDER_LEVEL 0
+#endif
+// Default count of log lines which flight recorder could keep.
+#ifndef LOG_FLIGHT_RECORDER_SIZE
+#define LOG_FLIGHT_RECORDER_SIZE 256
+#endif
+
 #define LOG_VER(fmt, ...)                                                       \
     if constexpr (static_cast<int>(LogLevel::Version) >= DEFAULT_LOG_LEVEL) {   \
         do {                                                                    \
@@ -125,6 +229,142 @@ constexpr int TransLogLevelToInt(LogLevel level) {
         } while(0);                                                             \
     }
 
+// Log a line followed by the dump lines of payload, such as:
+//     LOG_DEBUG_HEX(packet.data(), packet.size(), "Receive packet from %d", fd);
+// The payload is copied as raw bytes, and encoded by flush thread.
+#define LOG_PAYLOAD(level, encoding, payload, payloadSize, fmt, ...)          \
+    if constexpr (static_cast<int>(level) >= DEFAULT_LOG_LEVEL) {               \
+        do {                                                                    \
+            std::string_view tmpLogFmt = fmt;                                   \
+            std::array<char, LOG_MAX_LINE_SIZE> tmpLogLineBuf;                  \
+            snprintf(tmpLogLineBuf.data(), tmpLogLineBuf.size()                 \
+                    , tmpLogFmt.data(), ##__VA_ARGS__);                         \
+            detail::format_log_payload(level, encoding, payload, payloadSize    \
+                    , tmpLogLineBuf.data(), TAG);                               \
+        } while(0);                                                             \
+    }
+
+#define LOG_VER_HEX(payload, payloadSize, fmt, ...)   LOG_PAYLOAD(LogLevel::Version, detail::PayloadEncoding::Hex, payload, payloadSize, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG_HEX(payload, payloadSize, fmt, ...) LOG_PAYLOAD(LogLevel::Debug, detail::PayloadEncoding::Hex, payload, payloadSize, fmt, ##__VA_ARGS__)
+#define LOG_INFO_HEX(payload, payloadSize, fmt, ...)  LOG_PAYLOAD(LogLevel::Info, detail::PayloadEncoding::Hex, payload, payloadSize, fmt, ##__VA_ARGS__)
+#define LOG_WARN_HEX(payload, payloadSize, fmt, ...)  LOG_PAYLOAD(LogLevel::Warning, detail::PayloadEncoding::Hex, payload, payloadSize, fmt, ##__VA_ARGS__)
+#define LOG_ERR_HEX(payload, payloadSize, fmt, ...)   LOG_PAYLOAD(LogLevel::Error, detail::PayloadEncoding::Hex, payload, payloadSize, fmt, ##__VA_ARGS__)
+#define LOG_FATAL_HEX(payload, payloadSize, fmt, ...) LOG_PAYLOAD(LogLevel::Fatal, detail::PayloadEncoding::Hex, payload, payloadSize, fmt, ##__VA_ARGS__)
+
+#define LOG_VER_B64(payload, payloadSize, fmt, ...)   LOG_PAYLOAD(LogLevel::Version, detail::PayloadEncoding::Base64, payload, payloadSize, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG_B64(payload, payloadSize, fmt, ...) LOG_PAYLOAD(LogLevel::Debug, detail::PayloadEncoding::Base64, payload, payloadSize, fmt, ##__VA_ARGS__)
+#define LOG_INFO_B64(payload, payloadSize, fmt, ...)  LOG_PAYLOAD(LogLevel::Info, detail::PayloadEncoding::Base64, payload, payloadSize, fmt, ##__VA_ARGS__)
+#define LOG_WARN_B64(payload, payloadSize, fmt, ...)  LOG_PAYLOAD(LogLevel::Warning, detail::PayloadEncoding::Base64, payload, payloadSize, fmt, ##__VA_ARGS__)
+#define LOG_ERR_B64(payload, payloadSize, fmt, ...)   LOG_PAYLOAD(LogLevel::Error, detail::PayloadEncoding::Base64, payload, payloadSize, fmt, ##__VA_ARGS__)
+#define LOG_FATAL_B64(payload, payloadSize, fmt, ...) LOG_PAYLOAD(LogLevel::Fatal, detail::PayloadEncoding::Base64, payload, payloadSize, fmt, ##__VA_ARGS__)
+
+#define LOG_CONCAT_IMPL(a, b) a##b
+#define LOG_CONCAT(a, b) LOG_CONCAT_IMPL(a, b)
+
+// Record current scope as a trace span, the name must be a string literal.
+// All spans are written to "*.trace.json" in Chrome trace-event format, which are rotated and
+// deleted like log files.
+#define LOG_SCOPE(name)                                                         \
+    static detail::TraceSite LOG_CONCAT(tmpTraceSite, __LINE__) { name };      \
+    detail::TraceSpan LOG_CONCAT(tmpTraceSpan, __LINE__) { LOG_CONCAT(tmpTraceSite, __LINE__) }
+
+// Only record one of every "rate" spans which named "name", 0 means disable them.
+// Thread-safety.
+void setTraceSampleRate(std::string_view name, uint32_t rate);
+
+// Send log lines to collector instead of log file, address is "unix:/path/to/socket" or
+// "tcp:host:port", empty address means log file. The log lines are spilled to local file
+// when collector is unreachable, and would be replayed after it's reconnected.
+// The log lines are formatted by layout while they are sent to collector.
+// Host of tcp address is resolved once by this call, and the resolved addresses are reused
+// when reconnecting, so call it again to follow DNS changes.
+// Throw NormalException if address is invalid or host can't be resolved.
+// Thread-safety.
+void setLogSink(std::string_view address, LogLayoutFormatter layout = makeLogLayout<DEFAULT_LOG_LAYOUT>());
+
+// Select the layout of log lines which are written to log file, such as:
+//     setLogFileLayout(makeLogLayout<"%T.%u %t [%l] %m">());
+// Thread-safety.
+void setLogFileLayout(LogLayoutFormatter layout);
+
+// Flush thread sleeps until the first log line is buffered, and then flushes all log lines
+// after maxLatency, or when maxBatch full buffers are pending. LOG_ERR flushes immediately.
+// Thread-safety.
+void setLogFlushPolicy(std::chrono::milliseconds maxLatency, size_t maxBatch);
+
+// Statistics of log backend, which is used to measure the flush policy.
+struct LogStats {
+    uint64_t wakeups;       // Times of flush thread wakeup.
+    uint64_t writes;        // Times of write to log file or collector.
+    uint64_t writtenBytes;
+    uint64_t droppedFrames; // Log buffers dropped because collector and spill file are unavailable.
+};
+
+// Thread-safety.
+LogStats getLogStats();
+
+// Write the log lines kept in flight recorder to log file, and mark them as backfill.
+// Thread-safety.
+void dumpFlightRecorder();
+
+// LogRecordGroup collects many lines, and commits them as one contiguous block with a single
+// lock and a single timestamp, so that lines of other threads won't be interleaved into it.
+// Group is committed by destructor if commit() isn't called. Every line is prefixed, and
+// truncated to LOG_MAX_LINE_SIZE.
+// Not thread-safety!
+class LogRecordGroup {
+    DISABLE_COPY(LogRecordGroup);
+    DISABLE_MOVE(LogRecordGroup);
+public:
+    LogRecordGroup(LogLevel level, std::string_view tag)
+        : mLevel(level), mTag(tag) {}
+
+    ~LogRecordGroup() {
+        commit();
+    }
+
+    [[nodiscard]]
+    bool enabled() const {
+        return detail::TransLogLevelToInt(mLevel) >= DEFAULT_LOG_LEVEL;
+    }
+
+    // Append a line, the trailing '\n' is optional.
+    void append(std::string_view line) {
+        if (!enabled()) {
+            return ;
+        }
+        if (line.ends_with('\n')) {
+            line.remove_suffix(1);
+        }
+        mLines.append(line);
+        mLines.push_back('\n');
+    }
+
+    // Append a formatted line.
+    template <typename... Args>
+    void appendf(std::string_view fmt, Args... args) {
+        if (!enabled()) {
+            return ;
+        }
+        std::array<char, LOG_MAX_LINE_SIZE> lineBuf;
+        snprintf(lineBuf.data(), lineBuf.size(), fmt.data(), args...);
+        append(lineBuf.data());
+    }
+
+    // Write all lines to log buffer, the group can be reused after commit.
+    void commit() {
+        if (!mLines.empty()) {
+            detail::commit_log_group(mLevel, mLines, mTag);
+            mLines.clear();
+        }
+    }
+
+private:
+    LogLevel            mLevel;
+    std::string_view    mTag;
+    std::string         mLines;
+};
+
 void assertTrue(bool cond, std::string_view msg);
 
 void printBacktrace();
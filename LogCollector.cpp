@@ -0,0 +1,104 @@
+#include "LogCollector.h"
+#include "Error.h"
+
+#include <array>
+#include <cstring>
+
+extern "C" {
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+
+namespace utils {
+
+LogCollector::LogCollector(std::string_view address) : mAddress(detail::parseSinkAddress(address)) {
+    if (mAddress.isUnix) {
+        mpListener = std::make_unique<FileDesc>(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        if (mpListener->getRawFd() < 0) {
+            throw SystemException("Can't create collector socket because:");
+        }
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        ::strncpy(addr.sun_path, mAddress.path.c_str(), sizeof(addr.sun_path) - 1);
+        ::unlink(mAddress.path.c_str());
+        if (::bind(mpListener->getRawFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            throw SystemException("Can't bind collector socket because:");
+        }
+    } else {
+        addrinfo hints {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* addrList = nullptr;
+        if (auto err = ::getaddrinfo(mAddress.host.c_str(), mAddress.port.c_str(), &hints, &addrList); err != 0) {
+            throw NetworkException("Can't resolve collector address because:", err);
+        }
+        mpListener = std::make_unique<FileDesc>(::socket(addrList->ai_family, addrList->ai_socktype | SOCK_CLOEXEC, addrList->ai_protocol));
+        int reuse = 1;
+        ::setsockopt(mpListener->getRawFd(), SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        auto result = ::bind(mpListener->getRawFd(), addrList->ai_addr, addrList->ai_addrlen);
+        ::freeaddrinfo(addrList);
+        if (result < 0) {
+            throw SystemException("Can't bind collector socket because:");
+        }
+    }
+    if (::listen(mpListener->getRawFd(), SOMAXCONN) < 0) {
+        throw SystemException("Can't listen collector socket because:");
+    }
+}
+
+LogCollector::~LogCollector() {
+    if (mAddress.isUnix) {
+        ::unlink(mAddress.path.c_str());
+    }
+}
+
+void LogCollector::poll(std::chrono::milliseconds timeout, const std::function<void(std::string_view)>& handler) {
+    std::vector<pollfd> pollFds;
+    pollFds.push_back({ mpListener->getRawFd(), POLLIN, 0 });
+    for (auto& connection: mvConnections) {
+        pollFds.push_back({ connection.socket->getRawFd(), POLLIN, 0 });
+    }
+    if (::poll(pollFds.data(), pollFds.size(), static_cast<int>(timeout.count())) <= 0) {
+        return ;
+    }
+
+    // Receive frames of existed connections, close it if peer is closed.
+    std::array<char, 64 * 1024> readBuffer;
+    for (size_t i = mvConnections.size(); i > 0; --i) {
+        if (pollFds[i].revents == 0) {
+            continue;
+        }
+        auto& connection = mvConnections[i - 1];
+        auto readSize = ::read(connection.socket->getRawFd(), readBuffer.data(), readBuffer.size());
+        if (readSize <= 0) {
+            mvConnections.erase(mvConnections.begin() + (i - 1));
+            continue;
+        }
+        auto& buffer = connection.buffer;
+        buffer.insert(buffer.end(), readBuffer.data(), readBuffer.data() + readSize);
+        size_t offset = 0;
+        while (offset + detail::LOG_FRAME_HEADER_SIZE <= buffer.size()) {
+            auto payloadSize = detail::decodeFrameHeader(buffer.data() + offset);
+            if (offset + detail::LOG_FRAME_HEADER_SIZE + payloadSize > buffer.size()) {
+                break;
+            }
+            handler({ buffer.data() + offset + detail::LOG_FRAME_HEADER_SIZE, payloadSize });
+            offset += detail::LOG_FRAME_HEADER_SIZE + payloadSize;
+        }
+        buffer.erase(buffer.begin(), buffer.begin() + offset);
+    }
+
+    if (pollFds[0].revents & POLLIN) {
+        auto fd = ::accept4(mpListener->getRawFd(), nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            mvConnections.push_back({ std::make_unique<FileDesc>(fd), {} });
+        }
+    }
+}
+
+} // namespace utils
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "utils.h"
+#include "FileDesc.h"
+#include "LogSink.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace utils {
+
+// LogCollector is a local stand-in of log collector, which receives the frames sent by setLogSink().
+// Not thread-safety!
+class LogCollector {
+    DISABLE_COPY(LogCollector);
+    DISABLE_MOVE(LogCollector);
+public:
+    // Listen on "unix:/path/to/socket" or "tcp:host:port".
+    explicit LogCollector(std::string_view address);
+
+    ~LogCollector();
+
+    // Accept connections and receive frames until timeout, handler is called for every complete frame.
+    // The broken frame of a closed connection is dropped.
+    void poll(std::chrono::milliseconds timeout, const std::function<void(std::string_view)>& handler);
+
+private:
+    struct Connection {
+        std::unique_ptr<FileDesc>   socket;
+        std::vector<char>           buffer;
+    };
+
+    detail::SinkAddress         mAddress;
+    std::unique_ptr<FileDesc>   mpListener;
+    std::vector<Connection>     mvConnections;
+};
+
+} // namespace utils
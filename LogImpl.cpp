@@ -2,6 +2,9 @@
 #include "utils.h"
 #include "Error.h"
 #include "Backtrace.h"
+#include "FileDesc.h"
+#include "LogSink.h"
+#include "Encode.h"
 
 #include <algorithm>
 #include <cstddef>
@@ -17,7 +20,10 @@
 #include <future>
 #include <chrono>
 #include <vector>
-#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <tuple>
+#include <utility>
 #include <filesystem>
 
 #ifdef TAG
@@ -33,6 +39,10 @@ extern "C" {
 
 #if defined (__linux__) || defined (__unix__) || defined (__ANDROID__)
     #include <unistd.h>
+    #include <fcntl.h>
+    #include <limits.h>
+    #include <sys/file.h>
+    #include <sys/uio.h>
 #elif defined (__WIN32) || defined(__WIN64) || defined(WIN32)
     #include <windows.h>
 #else
@@ -78,22 +88,150 @@ public:
         return mUsedSize > 0;
     }
 
-    void flush(std::fstream &fileStream) {
-        fileStream.write(mRawBuffer.data(), mUsedSize);
-        fileStream.flush();
+    [[nodiscard]]
+    int size() const {
+        return mUsedSize;
+    }
+
+    [[nodiscard]]
+    const char* data() const {
+        return mRawBuffer.data();
+    }
+
+    void clear() {
         mUsedSize = 0;
+        mvPayloadOffsets.clear();
+    }
+
+    // Payload record need to be expanded before flush, call it before the record is written.
+    // Log line may contain any byte, so offsets of payload records are kept out of band.
+    void markPayload() {
+        mvPayloadOffsets.push_back(static_cast<uint32_t>(mUsedSize));
     }
 
     [[nodiscard]]
-    int size() const {
-        return mUsedSize;
+    const std::vector<uint32_t>& payloadOffsets() const {
+        return mvPayloadOffsets;
     }
 
 private:
     std::array<char, LOG_BUFFER_SIZE>   mRawBuffer;
     size_t                              mUsedSize;
+    std::vector<uint32_t>               mvPayloadOffsets;
+};
+
+// Payload record is stored in LogBuffer between log lines as:
+//     PayloadHeader | raw bytes
+// And its offset is recorded by LogBuffer::markPayload().
+struct PayloadHeader {
+    PayloadEncoding encoding;
+    uint32_t        size;
+    uint32_t        originalSize;
+};
+
+// Payload record must be stored in one LogBuffer.
+static_assert(sizeof(PayloadHeader) + LOG_MAX_PAYLOAD_SIZE <= LOG_BUFFER_SIZE);
+
+// Encode payload record to dump lines, such as "    0020: 0123456789abcdef...".
+static void append_payload_dump(const PayloadHeader& header, const uint8_t* payload, std::string& output) {
+    const bool isHex = header.encoding == PayloadEncoding::Hex;
+    // 32 bytes in every hex line, and 57 bytes in every base64 line, which is 76 characters.
+    const size_t bytesPerLine = isHex ? 32 : 57;
+    std::string encoded(isHex ? hexEncodedSize(header.size) : base64EncodedSize(header.size), '\0');
+    if (isHex) {
+        hexEncode(payload, header.size, encoded.data());
+    } else {
+        base64Encode(payload, header.size, encoded.data());
+    }
+    const size_t charsPerLine = isHex ? hexEncodedSize(bytesPerLine) : base64EncodedSize(bytesPerLine);
+    std::array<char, 64> offset = {};
+    for (size_t i = 0; i * charsPerLine < encoded.size(); ++i) {
+        snprintf(offset.data(), offset.size(), "    %04zx: ", i * bytesPerLine);
+        output.append(offset.data());
+        output.append(std::string_view(encoded).substr(i * charsPerLine, charsPerLine));
+        output.push_back('\n');
+    }
+    if (header.originalSize > header.size) {
+        snprintf(offset.data(), offset.size(), "    ... %u bytes truncated\n", header.originalSize - header.size);
+        output.append(offset.data());
+    }
+}
+
+// Return the content of buffer, payload records are expanded to output if there are.
+static std::string_view expand_payloads(const LogBuffer& buffer, std::string& output) {
+    std::string_view content { buffer.data(), static_cast<size_t>(buffer.size()) };
+    if (buffer.payloadOffsets().empty()) {
+        return content;
+    }
+    output.clear();
+    size_t lineBegin = 0;
+    for (auto offset: buffer.payloadOffsets()) {
+        output.append(content.substr(lineBegin, offset - lineBegin));
+        PayloadHeader header;
+        ::memcpy(&header, content.data() + offset, sizeof(header));
+        const auto* payload = reinterpret_cast<const uint8_t*>(content.data() + offset + sizeof(header));
+        append_payload_dump(header, payload, output);
+        lineBegin = offset + sizeof(header) + header.size;
+    }
+    output.append(content.substr(lineBegin));
+    return output;
+}
+
+// FlightRecorder keeps the latest log lines in memory, the oldest one would be overwritten.
+// Not thread-safety!
+class FlightRecorder {
+    DISABLE_COPY(FlightRecorder);
+    DISABLE_MOVE(FlightRecorder);
+
+public:
+    explicit FlightRecorder(size_t capacity) : mvLines(capacity) {
+        mNextLine = 0;
+        mLineCount = 0;
+    }
+
+    ~FlightRecorder() {}
+
+    void record(const char* srcData, size_t size) {
+        auto& line = mvLines[mNextLine];
+        size = std::min(size, line.rawLine.size());
+        ::memcpy(line.rawLine.data(), srcData, size);
+        line.size = size;
+        mNextLine = (mNextLine + 1) % mvLines.size();
+        mLineCount = std::min(mLineCount + 1, mvLines.size());
+    }
+
+    // Visit all log lines from the oldest one, and then clear flight recorder.
+    template <typename Func>
+    void drain(Func&& func) {
+        auto first = (mNextLine + mvLines.size() - mLineCount) % mvLines.size();
+        for (size_t i = 0; i < mLineCount; ++i) {
+            const auto& line = mvLines[(first + i) % mvLines.size()];
+            func(std::string_view { line.rawLine.data(), line.size });
+        }
+        mLineCount = 0;
+    }
+
+private:
+    struct Line {
+        std::array<char, LOG_MAX_LINE_SIZE> rawLine;
+        size_t                              size;
+    };
+
+    std::vector<Line>   mvLines;
+    size_t              mNextLine;
+    size_t              mLineCount;
 };
 
+// TraceEvent is the raw record of LOG_SCOPE, which is stored in LogBuffer directly.
+// It would be formatted to Chrome trace-event JSON by flush thread.
+struct TraceEvent {
+    const char* name;
+    int64_t     beginUs;
+    int64_t     endUs;
+    int         tid;
+};
+static_assert(std::is_trivially_copyable_v<TraceEvent>);
+
 // LogServer is the backend server, which manage multiple memory buffers and
 // flush these buffers to Log file asynchronously in appropriate time.
 class LogServer {
@@ -116,39 +254,255 @@ public:
     // Thread-safety.
     void write(LogLevel level, std::string_view fmt, std::string_view tag);
 
+    // Write a log line and the raw payload, which would be expanded to dump lines by flush thread.
+    // Trailing lines, such as backtrace of fatal log line, follow the payload with the same prefix.
+    // Thread-safety.
+    void writePayload(LogLevel level, PayloadEncoding encoding, const void* data, size_t size
+            , std::string_view fmt, std::string_view tag, std::string_view trailingLines = {});
+
+    // Write lines as one contiguous block, all lines share the same prefix.
+    // Thread-safety.
+    void writeGroup(LogLevel level, std::string_view lines, std::string_view tag);
+
+    // Write all log lines in flight recorder to log file as backfill.
+    // Thread-safety.
+    void dumpFlightRecorder();
+
+    // Send log buffers to collector instead of log file, empty address means log file.
+    // Log lines are formatted by layout while collector is used.
+    // Throw NormalException if address is invalid.
+    // Thread-safety.
+    void setSink(std::string_view address, LogLayoutFormatter layout);
+
+    // Thread-safety.
+    void setFileLayout(LogLayoutFormatter layout);
+
+    // Thread-safety.
+    void setFlushPolicy(milliseconds maxLatency, size_t maxBatch);
+
+    // Thread-safety.
+    auto getStats() -> LogStats;
+
+    // Client would call this function to record a finished trace span.
+    // Thread-safety.
+    void writeTrace(const TraceEvent& event);
+
 private:
-    auto createLogFileStream() -> std::fstream;
+    // Format the path of next log file, the pid and sequence number make it unique in log path.
+    // Trace files share the format with log files, but end with ".trace.json".
+    auto makeLogFilePath(std::string_view extension = ".log") -> std::string;
+
+    // Create log file, and preallocate disk space for it if preallocate is true.
+    // The file is locked shared until it's closed, so that retention never deletes it.
+    auto createLogFile(const std::string& filePath, bool preallocate) -> std::unique_ptr<FileDesc>;
+
+    // Switch to the log file prepared by maintain thread, it's only a descriptor swap.
+    // Call by flush thread.
+    void rotateLogFile();
+
+    // Delete the oldest log files until log files meet LOG_MAX_TOTAL_SIZE and LOG_MAX_FILE_AGE.
+    void removeExpiredLogFiles(const std::string& currentLogPath);
+
+    // Prepare next log file, retire old log files and apply retention policy.
+    void doMaintainAsync();
+
+    // Get a availble buffer, or create a new one. Must hold mMutex.
+    auto takeAvailbleBuffer() -> std::unique_ptr<LogBuffer>;
+
+    // Render the fields of log line except message, date and time are cached per second.
+    // Must hold mMutex.
+    auto makeFieldsLocked(LogLevel level, std::string_view tag) -> LogLineFields;
+
+    // Format log line by the layout of current output, return the length of log line.
+    // Must hold mMutex.
+    auto formatLineLocked(const LogLineFields& fields, std::array<char, LOG_MAX_LINE_SIZE>& logLine) -> size_t;
+
+    // Keep log line in flight recorder if its level is low, or dump flight recorder if error happen.
+    // Return true if the log line is kept by flight recorder. Must hold mMutex.
+    bool applyFlightRecorderLocked(LogLevel level, std::string_view line);
+
+    // Append a log line to current buffer, switch to new buffer if current buffer is full.
+    // Must hold mMutex.
+    void appendLineLocked(std::string_view prefix, std::string_view line);
+
+    // Append lines split by '\n', all lines share the given fields. Must hold mMutex.
+    void appendGroupLocked(LogLevel level, LogLineFields& fields, std::string_view lines);
+
+    // Must hold mMutex.
+    void dumpFlightRecorderLocked();
+
+    // Start the latency timer of flush thread when the first record is buffered.
+    // Must hold mMutex.
+    void onRecordBufferedLocked();
+
+    // Wait until buffered records need to be flushed, or flush thread need to exit.
+    // Call by flush thread, must hold mMutex.
+    void waitFlushEventLocked(std::unique_lock<std::mutex>& lock);
+
+    // Write buffers to log file by one writev(), and clear iovecs.
+    // Call by flush thread.
+    void writeLogFile(std::vector<iovec>& iovecs);
+
+    // Flush buffers to collector or log file, and clear them.
+    // Call by flush thread, don't hold mMutex.
+    void flushBuffers(const std::vector<std::unique_ptr<LogBuffer>>& buffers);
+
+    // Send buffer contents to collector, spill them if collector is unreachable.
+    // Call by flush thread.
+    void flushToSink(const std::vector<std::string_view>& frames);
+
+    // Take the first spill file which isn't used by other processes.
+    // Call by flush thread.
+    auto createSpillFile() -> std::unique_ptr<SpillFile>;
+
+    // Format trace events in buffer to trace file, rotate it at LOG_MAX_FILE_SIZE.
+    // Call by flush thread.
+    void flushTraceBuffer(const LogBuffer& buffer);
+
+    // Write formatted trace events to trace file, and clear them.
+    // Call by flush thread.
+    void writeTraceFile(std::string& traceLines);
+
+    // End the JSON array of trace file, and let maintain thread close it.
+    // Call by flush thread.
+    void closeTraceFile();
 
     void doFlushAsync();
 
-    // Default interval time which LogServer would flush all current buffer to log file.
-    static constexpr auto DEFAULT_FLUSH_INTERVAL = 2000ms;
+    // End of the JSON array in trace file.
+    static constexpr std::string_view TRACE_FILE_TAIL = "\n]\n";
+
+    // Processes share log path, so every running process takes its own spill file.
+    static constexpr int MAX_SPILL_FILE_COUNT = 16;
+
+    // Default interval time which maintain thread would check retention policy.
+    static constexpr auto DEFAULT_RETENTION_INTERVAL = 60s;
 
-    std::fstream            mLogFileStream;
+    // Only accessed by flush thread.
+    std::unique_ptr<FileDesc>
+                            mpLogFile;
     uint32_t                mLogAlreadyWritenBytes;
+    std::atomic<uint32_t>   mLogFileSequence;
+
+    // Members of log rotation, which are guarded by mFileMutex.
+    std::mutex              mFileMutex;
+    std::condition_variable mFileCond;
+    std::thread             mMaintainThread;
+    bool                    mStopMaintain;
+    // Next log file is created as a hidden file, and renamed after it's used.
+    // Processes share log path, so the pid is a part of its name.
+    std::string             mNextLogPath;
+    std::unique_ptr<FileDesc>
+                            mpNextLogFile;
+    // Formal name of taken next log file, which is decided when it's taken.
+    std::string             mTakenLogPath;
+    std::string             mCurrentLogPath;
+    std::vector<std::unique_ptr<FileDesc>>
+                            mvRetiredLogFiles;
 
     std::mutex              mMutex;
     std::condition_variable mCond;
     std::thread             mFlushThread;
     bool                    mStopThread;
+    // Records are dropped after flush thread exits, such as the ones written by other threads
+    // while LOG_FATAL is terminating process, or by destructors of static objects.
+    bool                    mFlushThreadExited;
     bool                    mNeedFlushNow;
+    // Flush policy, see setLogFlushPolicy().
+    milliseconds            mMaxLatency;
+    size_t                  mMaxBatch;
+    // Flush thread is sleeping until the first record is buffered.
+    bool                    mFlushIdle;
+    bool                    mHasBufferedRecord;
+    steady_clock::time_point
+                            mFirstBufferedTime;
+    // Statistics, which are updated by flush thread.
+    std::atomic<uint64_t>   mWakeups;
+    std::atomic<uint64_t>   mWrites;
+    std::atomic<uint64_t>   mWrittenBytes;
+    // Payload records expanded by flush thread, reused between flushes.
+    std::vector<std::string>
+                            mvExpandedBuffers;
     std::unique_ptr<LogBuffer>
                             mpCurrentBuffer;
     std::vector<std::unique_ptr<LogBuffer>>
                             mvAvailbleBuffers;
     std::vector<std::unique_ptr<LogBuffer>>
                             mvPendingBuffers;
+    // Only created if flight recorder is enabled.
+    std::unique_ptr<FlightRecorder>
+                            mpFlightRecorder;
+
+    // Layout is selected when log line is formatted, so it's protected by mMutex.
+    LogLayoutFormatter      mFileLayout;
+    LogLayoutFormatter      mSinkLayout;
+    bool                    mUseSinkLayout;
+    time_t                  mCachedSecond;
+    std::array<char, 48>    mCachedDate;
+    std::array<char, 48>    mCachedTime;
+
+    // New sink is set by client, and is taken by flush thread.
+    bool                    mSinkChanged;
+    std::unique_ptr<SocketSink>
+                            mpNewSink;
+    // Only accessed by flush thread.
+    std::unique_ptr<SocketSink>
+                            mpSink;
+    std::unique_ptr<SpillFile>
+                            mpSpillFile;
+    std::atomic<uint64_t>   mDroppedFrames;
+
+    // Trace events share the buffer pool with log lines, but flush to another file.
+    // Only accessed by flush thread.
+    std::unique_ptr<FileDesc>
+                            mpTraceFile;
+    uint32_t                mTraceAlreadyWritenBytes;
+    size_t                  mTraceEventCount;
+    std::unique_ptr<LogBuffer>
+                            mpCurrentTraceBuffer;
+    std::vector<std::unique_ptr<LogBuffer>>
+                            mvPendingTraceBuffers;
 };
 
 LogServer::LogServer() {
     // Create log file.
-    mLogFileStream = createLogFileStream();
+    mLogFileSequence = 0;
+    mCurrentLogPath = makeLogFilePath();
+    mpLogFile = createLogFile(mCurrentLogPath, false);
     mLogAlreadyWritenBytes = 0;
 
+    // Create maintain thread, which prepare next log file at once.
+    mStopMaintain = false;
+    mNextLogPath = std::string(DEFAULT_LOG_PATH) + "/.next." + std::to_string(::getpid()) + ".log";
+    mMaintainThread = std::thread([this] {
+        doMaintainAsync();
+    });
+
     // Create LogServer thread.
     mStopThread = false;
+    mFlushThreadExited = false;
     mNeedFlushNow = false;
+    mMaxLatency = milliseconds(LOG_FLUSH_MAX_LATENCY);
+    mMaxBatch = LOG_FLUSH_MAX_BATCH;
+    mFlushIdle = false;
+    mHasBufferedRecord = false;
+    mWakeups = 0;
+    mWrites = 0;
+    mWrittenBytes = 0;
     mpCurrentBuffer = std::make_unique<LogBuffer>();
+    if constexpr (LOG_FLIGHT_RECORDER_LEVEL > 0) {
+        mpFlightRecorder = std::make_unique<FlightRecorder>(LOG_FLIGHT_RECORDER_SIZE);
+    }
+    mSinkChanged = false;
+    mDroppedFrames = 0;
+    mFileLayout = makeLogLayout<DEFAULT_LOG_LAYOUT>();
+    mSinkLayout = mFileLayout;
+    mUseSinkLayout = false;
+    mCachedSecond = -1;
+    // Trace file is created lazily when the first trace event is flushed.
+    mTraceAlreadyWritenBytes = 0;
+    mTraceEventCount = 0;
+    mpCurrentTraceBuffer = std::make_unique<LogBuffer>();
     mFlushThread = std::thread([this] {
         doFlushAsync();
     });
@@ -160,14 +514,26 @@ LogServer::~LogServer() {
 
 void LogServer::forceDestroy() noexcept {
     try {
-        // std::lock_guard lock { mMutex };
+        // Flush thread may sleep without timeout, so lock mutex to avoid lost wakeup.
         // Notify flush thread to syncronize log buffer and close log file.
-        mStopThread = true;
-        mCond.notify_one();
+        {
+            std::lock_guard lock { mMutex };
+            mStopThread = true;
+            mCond.notify_one();
+        }
         // Destroy flush thread.
         if (mFlushThread.joinable()) {
             mFlushThread.join();
         }
+        // Destroy maintain thread after flush thread, because flush thread may retire log file.
+        {
+            std::lock_guard lock { mFileMutex };
+            mStopMaintain = true;
+            mFileCond.notify_one();
+        }
+        if (mMaintainThread.joinable()) {
+            mMaintainThread.join();
+        }
     } catch (...) {
         // ignore exception
     }
@@ -175,7 +541,8 @@ void LogServer::forceDestroy() noexcept {
 
 void LogServer::forceFlush() noexcept {
     try {
-        // std::lock_guard lock { mMutex };
+        // Flush thread may sleep without timeout, so lock mutex to avoid lost wakeup.
+        std::lock_guard lock { mMutex };
         mNeedFlushNow = true;
         mCond.notify_one();
     } catch (...) {
@@ -184,136 +551,528 @@ void LogServer::forceFlush() noexcept {
 }
 
 void LogServer::write(LogLevel level, std::string_view fmt, std::string_view tag) {
+    // We need lock at first time to make sure that the time sequence of input is right.
+    std::lock_guard lock { mMutex };
+    if (mFlushThreadExited) {
+        return ;
+    }
+
+    // Prepare log line.
+    auto fields = makeFieldsLocked(level, tag);
+    fields.message = fmt;
+    std::array<char, LOG_MAX_LINE_SIZE> logLine = {};
+    std::string_view line { logLine.data(), formatLineLocked(fields, logLine) };
+    if (applyFlightRecorderLocked(level, line)) {
+        return ;
+    }
+
+    // Write log line to memory buffer.
+    appendLineLocked({}, line);
+}
+
+void LogServer::writePayload(LogLevel level, PayloadEncoding encoding, const void* data, size_t size
+        , std::string_view fmt, std::string_view tag, std::string_view trailingLines) {
+    std::lock_guard lock { mMutex };
+    if (mFlushThreadExited) {
+        return ;
+    }
+
+    auto fields = makeFieldsLocked(level, tag);
+    fields.message = fmt;
+    std::array<char, LOG_MAX_LINE_SIZE> logLine = {};
+    std::string_view line { logLine.data(), formatLineLocked(fields, logLine) };
+    // Flight recorder only keeps log lines, so the payload is dropped.
+    if (applyFlightRecorderLocked(level, line)) {
+        return ;
+    }
+    appendLineLocked({}, line);
+
+    // Write payload record after its log line, copy raw bytes only.
+    PayloadHeader header {
+        .encoding = encoding,
+        .size = static_cast<uint32_t>(std::min<size_t>(size, LOG_MAX_PAYLOAD_SIZE)),
+        .originalSize = static_cast<uint32_t>(size),
+    };
+    const size_t recordSize = sizeof(header) + header.size;
+    if (!mpCurrentBuffer->writable(recordSize)) {
+        mvPendingBuffers.emplace_back(std::move(mpCurrentBuffer));
+        mpCurrentBuffer = takeAvailbleBuffer();
+        if (mvPendingBuffers.size() >= mMaxBatch) {
+            mCond.notify_one();
+        }
+    }
+    mpCurrentBuffer->markPayload();
+    mpCurrentBuffer->write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (header.size > 0) {
+        mpCurrentBuffer->write(static_cast<const char*>(data), header.size);
+    }
+    appendGroupLocked(level, fields, trailingLines);
+}
+
+void LogServer::writeGroup(LogLevel level, std::string_view lines, std::string_view tag) {
+    // Hold lock for the whole group, buffers are pending in order even if the group spans them.
+    std::lock_guard lock { mMutex };
+    if (mFlushThreadExited) {
+        return ;
+    }
+
+    // Render fields once, all lines share the same timestamp.
+    auto fields = makeFieldsLocked(level, tag);
+    appendGroupLocked(level, fields, lines);
+}
+
+void LogServer::appendGroupLocked(LogLevel level, LogLineFields& fields, std::string_view lines) {
+    std::array<char, LOG_MAX_LINE_SIZE> logLine = {};
+    while (!lines.empty()) {
+        auto lineEnd = lines.find('\n');
+        fields.message = lines.substr(0, lineEnd);
+        lines.remove_prefix(lineEnd == std::string_view::npos ? lines.size() : lineEnd + 1);
+
+        std::string_view line { logLine.data(), formatLineLocked(fields, logLine) };
+        if (!applyFlightRecorderLocked(level, line)) {
+            appendLineLocked({}, line);
+        }
+    }
+}
+
+LogLineFields LogServer::makeFieldsLocked(LogLevel level, std::string_view tag) {
 #if defined (__linux__) || defined (__unix__) || defined (__ANDROID__)
-    thread_local int pid = getpid();
-    thread_local int tid = gettid();
+    static const int pid = getpid();
+    thread_local const int tid = gettid();
 #elif defined (__WIN32) || defined(__WIN64) || defined(WIN32)
-    thread_local int pid = GetCurrentProcessId();
-    thread_local int tid = GetCurrentThreadId();
+    static const int pid = GetCurrentProcessId();
+    thread_local const int tid = GetCurrentThreadId();
 #else
     #error "Not support platform!"
 #endif
-    constexpr auto log_level_to_string= [] (LogLevel level) {
-        switch (level) {
-            case LogLevel::Version:
-                return "Ver  ";
-            case LogLevel::Debug:
-                return "Debug";
-            case LogLevel::Info:
-                return "Info ";
-            case LogLevel::Warning:
-                return "Warn ";
-            case LogLevel::Error:
-                return "Error";
-            case LogLevel::Fatal:
-                return "Fatal";
-            default:
-                return " ";
-        }
+    constexpr auto render_id = [] (int id) {
+        std::array<char, 16> buffer = {};
+        snprintf(buffer.data(), buffer.size(), "%5d", id);
+        return std::string(buffer.data());
+    };
+    // Constant fields are rendered once, and tid is rendered once per thread.
+    static const std::string pidField = render_id(pid);
+    thread_local const std::string tidField = render_id(tid);
+    static constexpr std::array<std::string_view, 6> levelFields = {
+        "Ver  ", "Debug", "Info ", "Warn ", "Error", "Fatal",
     };
 
-    // We need lock at first time to make sure that the time sequence of input is right.
-    std::lock_guard lock { mMutex };
-
-    // Prepare log line.
-    std::array<char, LOG_MAX_LINE_SIZE> logLine = {};
-    time_t t = time(nullptr);
-    struct tm now = {};
-    // Get local time, it's not a system call.
-    // TODO: Deal with this exception.
-    if (localtime_r(&t, &now) == nullptr) {
-        throw SystemException("Can't get current time.");
+    auto timeSinceEpoch = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+    time_t t = static_cast<time_t>(timeSinceEpoch / 1000000);
+    if (t != mCachedSecond) {
+        struct tm now = {};
+        // Get local time, it's not a system call.
+        // TODO: Deal with this exception.
+        if (localtime_r(&t, &now) == nullptr) {
+            throw SystemException("Can't get current time.");
+        }
+        snprintf(mCachedDate.data(), mCachedDate.size(), "%04d-%02d-%02d"
+                , now.tm_year + 1900, now.tm_mon + 1, now.tm_mday);
+        snprintf(mCachedTime.data(), mCachedTime.size(), "%02d.%02d.%02d"
+                , now.tm_hour, now.tm_min, now.tm_sec);
+        mCachedSecond = t;
     }
 
-    // Get milliseconds suffix
-    auto timeSinceEpoch = std::chrono::system_clock::now().time_since_epoch().count();
-    auto milliSeconds = static_cast<int>(timeSinceEpoch % (1000 * 1000 * 1000)) / 1000;
+    auto levelIndex = static_cast<size_t>(TransLogLevelToInt(level));
+    return LogLineFields {
+        .date = mCachedDate.data(),
+        .time = mCachedTime.data(),
+        .microseconds = static_cast<int>(timeSinceEpoch % 1000000),
+        .pid = pidField,
+        .tid = tidField,
+        .level = levelIndex < levelFields.size() ? levelFields[levelIndex] : " ",
+        .tag = tag,
+        .message = {},
+    };
+}
 
-    // Format log line.
-    int logLineLength = snprintf(logLine.data(), logLine.size(), "%04d-%02d-%02d %02d.%02d.%02d.%06d %5d %5d [%s][%s] %s\n"
-            , now.tm_year + 1900, now.tm_mon + 1, now.tm_mday
-            , now.tm_hour, now.tm_min, now.tm_sec
-            , milliSeconds
-            , pid, tid
-            , log_level_to_string(level)
-            , tag.data()
-            , fmt.data());
-    // TODO: Deal with this exception.
-    if (logLineLength < 0) {
-        throw SystemException("Error happen when format string.");
+size_t LogServer::formatLineLocked(const LogLineFields& fields, std::array<char, LOG_MAX_LINE_SIZE>& logLine) {
+    auto layout = mUseSinkLayout ? mSinkLayout : mFileLayout;
+    return layout(fields, logLine.data(), logLine.size());
+}
+
+bool LogServer::applyFlightRecorderLocked(LogLevel level, std::string_view line) {
+    if (!mpFlightRecorder) {
+        return false;
+    }
+    // Low level log line is kept in flight recorder only.
+    if (TransLogLevelToInt(level) < LOG_FLIGHT_RECORDER_LEVEL) {
+        mpFlightRecorder->record(line.data(), line.size());
+        return true;
+    }
+    // Write the context of error before the error log line.
+    [[unlikely]]
+    if (level >= LogLevel::Error) {
+        dumpFlightRecorderLocked();
     }
+    return false;
+}
 
-    // Write log line to memory buffer.
-    if (mpCurrentBuffer->writable(logLineLength)) {
-        mpCurrentBuffer->write(logLine.data(), logLineLength);
-    } else {
+void LogServer::appendLineLocked(std::string_view prefix, std::string_view line) {
+    onRecordBufferedLocked();
+    if (!mpCurrentBuffer->writable(prefix.size() + line.size())) {
         // Current buffer is full, need to flush.
         mvPendingBuffers.emplace_back(std::move(mpCurrentBuffer));
         // And get new availble buffer.
-        if (mvAvailbleBuffers.empty()) {
-            mpCurrentBuffer = std::make_unique<LogBuffer>();
-        } else {
-            mpCurrentBuffer = std::move(mvAvailbleBuffers.back());
-            mvAvailbleBuffers.pop_back();
+        mpCurrentBuffer = takeAvailbleBuffer();
+        // Notify backend server to flush pending buffers if batch is full.
+        if (mvPendingBuffers.size() >= mMaxBatch) {
+            mCond.notify_one();
         }
-        mpCurrentBuffer->write(logLine.data(), logLineLength);
-        // Notify backend server to flush pending buffers.
+    }
+    if (!prefix.empty()) {
+        mpCurrentBuffer->write(prefix.data(), prefix.size());
+    }
+    mpCurrentBuffer->write(line.data(), line.size());
+}
+
+void LogServer::dumpFlightRecorder() {
+    std::lock_guard lock { mMutex };
+    if (mpFlightRecorder && !mFlushThreadExited) {
+        dumpFlightRecorderLocked();
+    }
+}
+
+void LogServer::dumpFlightRecorderLocked() {
+    mpFlightRecorder->drain([this] (std::string_view line) {
+        appendLineLocked("[Backfill] ", line);
+    });
+}
+
+void LogServer::onRecordBufferedLocked() {
+    if (mHasBufferedRecord) {
+        return ;
+    }
+    mHasBufferedRecord = true;
+    mFirstBufferedTime = steady_clock::now();
+    if (mFlushIdle) {
         mCond.notify_one();
     }
 }
 
+void LogServer::setFlushPolicy(milliseconds maxLatency, size_t maxBatch) {
+    std::lock_guard lock { mMutex };
+    mMaxLatency = maxLatency;
+    mMaxBatch = std::max<size_t>(maxBatch, 1);
+    mCond.notify_one();
+}
+
+LogStats LogServer::getStats() {
+    return LogStats {
+        .wakeups = mWakeups.load(std::memory_order_relaxed),
+        .writes = mWrites.load(std::memory_order_relaxed),
+        .writtenBytes = mWrittenBytes.load(std::memory_order_relaxed),
+        .droppedFrames = mDroppedFrames.load(std::memory_order_relaxed),
+    };
+}
+
+void LogServer::writeTrace(const TraceEvent& event) {
+    std::lock_guard lock { mMutex };
+    if (mFlushThreadExited) {
+        return ;
+    }
+    onRecordBufferedLocked();
+    if (!mpCurrentTraceBuffer->writable(sizeof(event))) {
+        mvPendingTraceBuffers.emplace_back(std::move(mpCurrentTraceBuffer));
+        mpCurrentTraceBuffer = takeAvailbleBuffer();
+        if (mvPendingTraceBuffers.size() >= mMaxBatch) {
+            mCond.notify_one();
+        }
+    }
+    mpCurrentTraceBuffer->write(reinterpret_cast<const char*>(&event), sizeof(event));
+}
+
+std::unique_ptr<LogBuffer> LogServer::takeAvailbleBuffer() {
+    if (mvAvailbleBuffers.empty()) {
+        return std::make_unique<LogBuffer>();
+    }
+    auto buffer = std::move(mvAvailbleBuffers.back());
+    mvAvailbleBuffers.pop_back();
+    return buffer;
+}
+
+void LogServer::setSink(std::string_view address, LogLayoutFormatter layout) {
+    std::unique_ptr<SocketSink> sink;
+    if (!address.empty()) {
+        sink = std::make_unique<SocketSink>(address);
+    }
+    std::lock_guard lock { mMutex };
+    mpNewSink = std::move(sink);
+    mSinkChanged = true;
+    mSinkLayout = layout;
+    mUseSinkLayout = !address.empty();
+}
+
+void LogServer::setFileLayout(LogLayoutFormatter layout) {
+    std::lock_guard lock { mMutex };
+    mFileLayout = layout;
+}
+
+void LogServer::flushBuffers(const std::vector<std::unique_ptr<LogBuffer>>& buffers) {
+    // Expand payload records to dump lines at first.
+    std::vector<std::string_view> contents;
+    mvExpandedBuffers.resize(std::max(mvExpandedBuffers.size(), buffers.size()));
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        if (buffers[i]->flushEnable()) {
+            contents.push_back(expand_payloads(*buffers[i], mvExpandedBuffers[i]));
+        }
+    }
+    if (mpSink) {
+        flushToSink(contents);
+    } else {
+        // Write the whole batch by one writev(), unless log file is rotated.
+        std::vector<iovec> iovecs;
+        for (auto content: contents) {
+            if (content.size() + mLogAlreadyWritenBytes >= LOG_MAX_FILE_SIZE) {
+                // std::cout << __FUNCTION__ << ": Log file is full, switch to new log file." << std::endl;
+                writeLogFile(iovecs);
+                rotateLogFile();
+            }
+            mLogAlreadyWritenBytes += content.size();
+            iovecs.push_back({ const_cast<char*>(content.data()), content.size() });
+        }
+        writeLogFile(iovecs);
+    }
+    for (auto& buffer: buffers) {
+        buffer->clear();
+    }
+}
+
+void LogServer::writeLogFile(std::vector<iovec>& iovecs) {
+    size_t iovIndex = 0;
+    while (iovIndex < iovecs.size()) {
+        auto count = std::min<size_t>(iovecs.size() - iovIndex, IOV_MAX);
+        auto result = mpLogFile->writev({ iovecs.data() + iovIndex, count });
+        // Disk is full or other IO error happen, drop these buffers.
+        if (result <= 0) {
+            break;
+        }
+        mWrites.fetch_add(1, std::memory_order_relaxed);
+        mWrittenBytes.fetch_add(result, std::memory_order_relaxed);
+        auto writtenSize = static_cast<size_t>(result);
+        while (writtenSize > 0) {
+            auto& iov = iovecs[iovIndex];
+            if (writtenSize >= iov.iov_len) {
+                writtenSize -= iov.iov_len;
+                ++iovIndex;
+            } else {
+                iov.iov_base = static_cast<char*>(iov.iov_base) + writtenSize;
+                iov.iov_len -= writtenSize;
+                writtenSize = 0;
+            }
+        }
+    }
+    iovecs.clear();
+}
+
+void LogServer::flushToSink(const std::vector<std::string_view>& frames) {
+    try {
+        // Spill file is kept between processes, so the frames left by last process are replayed too.
+        if (!mpSpillFile) {
+            mpSpillFile = createSpillFile();
+        }
+        // Replay spilled frames at first to keep the order of log lines.
+        size_t sentCount = 0;
+        if (mpSpillFile->empty() || mpSpillFile->replay(*mpSink)) {
+            sentCount = mpSink->send(frames);
+        }
+        if (sentCount > 0) {
+            mWrites.fetch_add(1, std::memory_order_relaxed);
+            for (size_t i = 0; i < sentCount; ++i) {
+                mWrittenBytes.fetch_add(frames[i].size(), std::memory_order_relaxed);
+            }
+        }
+        for (size_t i = sentCount; i < frames.size(); ++i) {
+            if (!mpSpillFile->append(frames[i])) {
+                ++mDroppedFrames;
+            }
+        }
+    } catch (const std::exception& e) {
+        // Collector and spill file are both unavailable, drop these log lines.
+        std::cerr << e.what() << std::endl;
+        mDroppedFrames += frames.size();
+    }
+}
+
+std::unique_ptr<SpillFile> LogServer::createSpillFile() {
+    for (int i = 0; i < MAX_SPILL_FILE_COUNT; ++i) {
+        auto path = std::string(DEFAULT_LOG_PATH) + (i == 0 ? "/.spill.dat" : "/.spill." + std::to_string(i) + ".dat");
+        try {
+            return std::make_unique<SpillFile>(path, LOG_SINK_MAX_SPILL_SIZE);
+        } catch (const NormalException&) {
+            // Used by another process, try next one.
+        }
+    }
+    throw NormalException("All spill files are used by other processes.", ErrorCode::OpNotAllowed);
+}
+
+void LogServer::flushTraceBuffer(const LogBuffer& buffer) {
+#if defined (__linux__) || defined (__unix__) || defined (__ANDROID__)
+    static const int pid = getpid();
+#elif defined (__WIN32) || defined(__WIN64) || defined(WIN32)
+    static const int pid = GetCurrentProcessId();
+#endif
+    std::string traceLines;
+    std::string eventLine;
+    std::array<char, 128> numbers = {};
+    const auto eventCount = buffer.size() / sizeof(TraceEvent);
+    for (size_t i = 0; i < eventCount; ++i) {
+        TraceEvent event;
+        ::memcpy(&event, buffer.data() + i * sizeof(TraceEvent), sizeof(event));
+        // Use "Complete" event, so that begin and end event needn't be matched by viewer.
+        eventLine.assign("{\"name\":\"");
+        // Quote, backslash and control characters must be escaped in JSON string.
+        for (const char* p = event.name; *p != '\0'; ++p) {
+            if (static_cast<unsigned char>(*p) < 0x20) {
+                snprintf(numbers.data(), numbers.size(), "\\u%04x", static_cast<unsigned>(*p));
+                eventLine.append(numbers.data());
+                continue;
+            }
+            if (*p == '"' || *p == '\\') {
+                eventLine.push_back('\\');
+            }
+            eventLine.push_back(*p);
+        }
+        snprintf(numbers.data(), numbers.size(), "\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d}"
+                , static_cast<long long>(event.beginUs)
+                , static_cast<long long>(event.endUs - event.beginUs)
+                , pid, event.tid);
+        eventLine.append(numbers.data());
+
+        // Trace file is rotated like log file, and every trace file is a complete JSON array.
+        // Reserve space for the separator and the end of array.
+        const auto eventSize = eventLine.size() + TRACE_FILE_TAIL.size() + 2;
+        if (mpTraceFile && mTraceEventCount > 0
+                && mTraceAlreadyWritenBytes + traceLines.size() + eventSize > LOG_MAX_FILE_SIZE) {
+            writeTraceFile(traceLines);
+            closeTraceFile();
+        }
+        if (!mpTraceFile) {
+            mpTraceFile = createLogFile(makeLogFilePath(".trace.json"), false);
+            mTraceAlreadyWritenBytes = 0;
+            mTraceEventCount = 0;
+            traceLines.push_back('[');
+        }
+        traceLines.append(mTraceEventCount++ == 0 ? "\n" : ",\n");
+        traceLines.append(eventLine);
+    }
+    writeTraceFile(traceLines);
+}
+
+void LogServer::writeTraceFile(std::string& traceLines) {
+    std::string_view rest = traceLines;
+    while (!rest.empty()) {
+        auto result = mpTraceFile->write(rest);
+        // Disk is full or other IO error happen, drop these events.
+        if (result <= 0) {
+            break;
+        }
+        mTraceAlreadyWritenBytes += result;
+        rest.remove_prefix(result);
+    }
+    traceLines.clear();
+}
+
+void LogServer::closeTraceFile() {
+    std::string traceLines { TRACE_FILE_TAIL };
+    writeTraceFile(traceLines);
+    std::lock_guard lock { mFileMutex };
+    // Closing file may take long time, let maintain thread do it.
+    mvRetiredLogFiles.emplace_back(std::move(mpTraceFile));
+    mFileCond.notify_one();
+}
+
+void LogServer::waitFlushEventLocked(std::unique_lock<std::mutex>& lock) {
+    auto batchFull = [this] {
+        return mvPendingBuffers.size() >= mMaxBatch || mvPendingTraceBuffers.size() >= mMaxBatch;
+    };
+    while (!mStopThread && !mNeedFlushNow) {
+        if (!mHasBufferedRecord) {
+            // Nothing to flush, sleep until the first record is buffered.
+            // But spilled log lines need to be replayed periodically.
+            auto wakeup = [this] {
+                return mStopThread || mNeedFlushNow || mHasBufferedRecord;
+            };
+            mFlushIdle = true;
+            if (mpSink && mpSpillFile && !mpSpillFile->empty()) {
+                auto woken = mCond.wait_for(lock, mMaxLatency, wakeup);
+                mFlushIdle = false;
+                mWakeups.fetch_add(1, std::memory_order_relaxed);
+                if (!woken) {
+                    return ;
+                }
+            } else {
+                mCond.wait(lock, wakeup);
+                mFlushIdle = false;
+                mWakeups.fetch_add(1, std::memory_order_relaxed);
+            }
+            continue;
+        }
+        // Flush when batch is full or the first record reaches max latency.
+        auto deadline = mFirstBufferedTime + mMaxLatency;
+        if (batchFull() || steady_clock::now() >= deadline) {
+            return ;
+        }
+        mCond.wait_until(lock, deadline, [&] {
+            return mStopThread || mNeedFlushNow || batchFull();
+        });
+        mWakeups.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
 void LogServer::doFlushAsync() {
     std::vector<std::unique_ptr<LogBuffer>> needFlushBuffers;
-    while (!mStopThread) {
+    std::vector<std::unique_ptr<LogBuffer>> needFlushTraceBuffers;
+    // mStopThread is checked with mMutex held, so that buffers written before stop are never lost.
+    while (true) {
         // Get pending buffers.
         {
             std::unique_lock lock { mMutex };
-            // Wait for availble pending buffers.
-            auto timeout = !mCond.wait_for(lock, DEFAULT_FLUSH_INTERVAL, [&] {
-                return mStopThread || !mvPendingBuffers.empty() || mNeedFlushNow;
-            });
+            waitFlushEventLocked(lock);
+            // Take the sink set by client.
+            if (mSinkChanged) {
+                mpSink = std::move(mpNewSink);
+                mSinkChanged = false;
+            }
             // Flush thread is exited, so flush all buffers, and then close log file.
             if (mStopThread) {
-                for (auto& buffer: mvPendingBuffers) {
-                    buffer->flush(mLogFileStream);
+                // Keep current buffer valid, records written later are dropped by mFlushThreadExited.
+                mvPendingBuffers.emplace_back(std::exchange(mpCurrentBuffer, takeAvailbleBuffer()));
+                flushBuffers(mvPendingBuffers);
+                mpLogFile.reset();
+                for (auto& buffer: mvPendingTraceBuffers) {
+                    flushTraceBuffer(*buffer);
+                }
+                if (mpCurrentTraceBuffer->flushEnable()) {
+                    flushTraceBuffer(*mpCurrentTraceBuffer);
                 }
-                if (mpCurrentBuffer->flushEnable()) {
-                    mpCurrentBuffer->flush(mLogFileStream);
+                if (mpTraceFile) {
+                    closeTraceFile();
                 }
-                mLogFileStream.flush();
-                mLogFileStream.close();
+                mFlushThreadExited = true;
                 return ;
             }
-            // Condition wait time out, there has no pending buffers, so flush current buffer to log file.
-            // mNeedFlushNow == true, so need to flush current buffer immediately.
-            if (timeout || mNeedFlushNow) {
+            // Flush all buffered records, include the current buffers which are not full,
+            // so that the latency timer starts again from the next record.
+            if (mpCurrentBuffer->flushEnable()) {
                 mvPendingBuffers.emplace_back(std::move(mpCurrentBuffer));
-                if (mvAvailbleBuffers.empty()) {
-                    mpCurrentBuffer = std::make_unique<LogBuffer>();
-                } else {
-                    mpCurrentBuffer = std::move(mvAvailbleBuffers.back());
-                    mvAvailbleBuffers.pop_back();
-                }
-                // set mNeedFlushNow as false.
-                [[unlikely]]
-                if (mNeedFlushNow) {
-                    mNeedFlushNow = false;
-                }
+                mpCurrentBuffer = takeAvailbleBuffer();
+            }
+            if (mpCurrentTraceBuffer->flushEnable()) {
+                mvPendingTraceBuffers.emplace_back(std::move(mpCurrentTraceBuffer));
+                mpCurrentTraceBuffer = takeAvailbleBuffer();
             }
+            mNeedFlushNow = false;
+            mHasBufferedRecord = false;
             needFlushBuffers.swap(mvPendingBuffers);
+            needFlushTraceBuffers.swap(mvPendingTraceBuffers);
         }
         // Start flush buffer to log file.
         // This operation may take long time, so don't lock mutex now.
-        for (auto& buffer: needFlushBuffers) {
-            if (buffer->size() + mLogAlreadyWritenBytes >= LOG_MAX_FILE_SIZE) {
-                // std::cout << __FUNCTION__ << ": Log file is full, create new log file." << std::endl;
-                mLogFileStream.flush();
-                mLogFileStream.close();
-                mLogFileStream = createLogFileStream();
-                mLogAlreadyWritenBytes = 0;
-            }
-            mLogAlreadyWritenBytes += buffer->size();
-            buffer->flush(mLogFileStream);
+        flushBuffers(needFlushBuffers);
+        for (auto& buffer: needFlushTraceBuffers) {
+            flushTraceBuffer(*buffer);
+            buffer->clear();
         }
         // Return availble buffers.
         // std::cout << __FUNCTION__ << ": Return buffers" << std::endl;
@@ -323,24 +1082,16 @@ void LogServer::doFlushAsync() {
                 mvAvailbleBuffers.emplace_back(std::move(buffer));
             }
             needFlushBuffers.clear();
+            for (auto& buffer: needFlushTraceBuffers) {
+                mvAvailbleBuffers.emplace_back(std::move(buffer));
+            }
+            needFlushTraceBuffers.clear();
         }
     }
 
 }
 
-std::fstream LogServer::createLogFileStream() {
-    // Create log path and change its permissions to 0777.
-    // TODO: Permission error may be happen, how to deal with that case?
-    try {
-        // create_directory() return false because the directory is existed, ignored it.
-        // We just focus on the case which create_directory() or permissions() throw a exception
-        std::filesystem::create_directory(DEFAULT_LOG_PATH);
-        std::filesystem::permissions(DEFAULT_LOG_PATH, std::filesystem::perms::all);
-    } catch (...) {
-        throw SystemException("Can't create log filePath because:");
-    }
-
-    // Format the name of log file.
+std::string LogServer::makeLogFilePath(std::string_view extension) {
     std::array<char, 128> filePath = {};
     time_t t = time(nullptr);
     struct tm now = {};
@@ -348,44 +1099,315 @@ std::fstream LogServer::createLogFileStream() {
     if (localtime_r(&t, &now) == nullptr) {
         throw SystemException("Can't get current time.");
     }
-    snprintf(filePath.data(), filePath.size(), "%s/%04d-%02d-%02d_%02d-%02d-%02d.log"
+    // Log files may be rotated more than once in one second by many processes,
+    // so append pid and sequence number to it.
+    snprintf(filePath.data(), filePath.size(), "%s/%04d-%02d-%02d_%02d-%02d-%02d_%d_%03u%.*s"
             , DEFAULT_LOG_PATH
             , now.tm_year + 1900, now.tm_mon + 1, now.tm_mday
             , now.tm_hour, now.tm_min, now.tm_sec
+            , static_cast<int>(::getpid())
+            , mLogFileSequence.fetch_add(1, std::memory_order_relaxed)
+            , static_cast<int>(extension.size()), extension.data()
     );
+    return filePath.data();
+}
+
+std::unique_ptr<FileDesc> LogServer::createLogFile(const std::string& filePath, bool preallocate) {
+    // Create log path and change its permissions to 0777.
+    // TODO: Permission error may be happen, how to deal with that case?
+    try {
+        // create_directories() return false because the directory is existed, ignored it.
+        // We just focus on the case which create_directories() or permissions() throw a exception
+        std::filesystem::create_directories(DEFAULT_LOG_PATH);
+        std::filesystem::permissions(DEFAULT_LOG_PATH, std::filesystem::perms::all);
+    } catch (...) {
+        throw SystemException("Can't create log filePath because:");
+    }
 
     // Create log file.
+    std::unique_ptr<FileDesc> logFile;
     try {
-        auto fileStream = std::fstream(filePath.data(), std::ios::in | std::ios::out | std::ios::trunc);
-        return fileStream;
+        logFile = std::make_unique<FileDesc>(filePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
     } catch (...) {
         throw SystemException("Can't create log file because:");
     }
+    ::flock(logFile->getRawFd(), LOCK_SH | LOCK_NB);
+#if defined (__linux__)
+    // Keep the file size, so that the tail of log file is not filled with zero.
+    // Failure is acceptable, such as the file system doesn't support fallocate.
+    if (preallocate) {
+        ::fallocate(logFile->getRawFd(), FALLOC_FL_KEEP_SIZE, 0, LOG_MAX_FILE_SIZE);
+    }
+#endif
+    return logFile;
 }
 
-void format_log_line(LogLevel level, std::string_view fmt, std::string_view tag) noexcept {
+void LogServer::rotateLogFile() {
+    std::unique_ptr<FileDesc> nextLogFile;
+    {
+        std::lock_guard lock { mFileMutex };
+        // Closing file may take long time, let maintain thread do it.
+        mvRetiredLogFiles.emplace_back(std::move(mpLogFile));
+        if (mpNextLogFile) {
+            nextLogFile = std::move(mpNextLogFile);
+            // So that sequence numbers follow the order of log files.
+            mTakenLogPath = makeLogFilePath();
+            // It's active under the hidden name, until maintain thread renames it.
+            mCurrentLogPath = mNextLogPath;
+        }
+        mFileCond.notify_one();
+    }
+    mLogAlreadyWritenBytes = 0;
+    if (nextLogFile) {
+        mpLogFile = std::move(nextLogFile);
+        return ;
+    }
+    // Maintain thread hasn't prepared next log file yet, create it directly.
+    auto filePath = makeLogFilePath();
+    mpLogFile = createLogFile(filePath, false);
+    std::lock_guard lock { mFileMutex };
+    mCurrentLogPath = std::move(filePath);
+}
+
+// Every process holds its log files locked shared, so a file is in use if it can't be locked exclusively.
+static bool isLogFileInUse(const std::filesystem::path& path) {
+    try {
+        FileDesc file { path.string(), O_RDONLY | O_CLOEXEC };
+        return ::flock(file.getRawFd(), LOCK_EX | LOCK_NB) < 0;
+    } catch (const std::system_error&) {
+        return false;
+    }
+}
+
+void LogServer::removeExpiredLogFiles(const std::string& currentLogPath) {
+    if constexpr (LOG_MAX_TOTAL_SIZE == 0 && LOG_MAX_FILE_AGE == 0) {
+        return ;
+    }
+    struct LogFileInfo {
+        std::filesystem::path               path;
+        uintmax_t                           size;
+        std::filesystem::file_time_type     lastWriteTime;
+    };
+    std::vector<LogFileInfo> logFiles;
+    uintmax_t totalSize = 0;
+    std::error_code err;
+    for (const auto& entry: std::filesystem::directory_iterator(DEFAULT_LOG_PATH, err)) {
+        const auto& path = entry.path();
+        auto fileName = path.filename().string();
+        // Hidden next log files are left by processes which were killed before renaming them.
+        // Trace files share retention policy with log files.
+        bool isLogFile = path.extension() == ".log" || fileName.ends_with(".trace.json");
+        if (!entry.is_regular_file(err) || !isLogFile
+                || (fileName.starts_with(".") && !fileName.starts_with(".next."))) {
+            continue;
+        }
+        auto size = entry.file_size(err);
+        if (err) {
+            continue;
+        }
+        totalSize += size;
+        // Current log file is counted in total size, but never be deleted.
+        if (path == currentLogPath) {
+            continue;
+        }
+        auto lastWriteTime = entry.last_write_time(err);
+        if (err) {
+            continue;
+        }
+        logFiles.push_back({ path, size, lastWriteTime });
+    }
+
+    // Delete log files from the oldest one.
+    // Timestamp of file system is coarse, so log files written in one tick are ordered by name.
+    std::sort(logFiles.begin(), logFiles.end(), [] (const auto& lhs, const auto& rhs) {
+        return std::tie(lhs.lastWriteTime, lhs.path) < std::tie(rhs.lastWriteTime, rhs.path);
+    });
+    const auto now = std::filesystem::file_time_type::clock::now();
+    for (const auto& logFile: logFiles) {
+        bool tooLarge = LOG_MAX_TOTAL_SIZE > 0 && totalSize > static_cast<uintmax_t>(LOG_MAX_TOTAL_SIZE);
+        bool tooOld = LOG_MAX_FILE_AGE > 0 && now - logFile.lastWriteTime > seconds(LOG_MAX_FILE_AGE);
+        if (!tooLarge && !tooOld) {
+            continue;
+        }
+        // Log files of other processes are counted, but never be deleted while they are in use.
+        if (isLogFileInUse(logFile.path)) {
+            continue;
+        }
+        if (std::filesystem::remove(logFile.path, err)) {
+            totalSize -= logFile.size;
+        }
+    }
+}
+
+void LogServer::doMaintainAsync() {
+    // Prepared log file has been taken, but isn't renamed yet. Its name can't be reused until
+    // then, otherwise the records in it are truncated.
+    std::string takenLogPath;
+    std::unique_lock lock { mFileMutex };
+    while (!mStopMaintain) {
+        auto retiredLogFiles = std::move(mvRetiredLogFiles);
+        mvRetiredLogFiles.clear();
+        if (!mTakenLogPath.empty()) {
+            takenLogPath = std::exchange(mTakenLogPath, {});
+        }
+        auto needPrepare = !mpNextLogFile;
+        lock.unlock();
+
+        // Close old log files.
+        retiredLogFiles.clear();
+        // Prepared log file is taken, give it the formal name. Try again in next round if failed.
+        bool renamed = false;
+        if (!takenLogPath.empty()) {
+            std::error_code err;
+            std::filesystem::rename(mNextLogPath, takenLogPath, err);
+            renamed = !err;
+        }
+        std::unique_ptr<FileDesc> nextLogFile;
+        if (needPrepare && (takenLogPath.empty() || renamed)) {
+            try {
+                nextLogFile = createLogFile(mNextLogPath, true);
+            } catch (const std::exception& e) {
+                // Try again in next round, flush thread would create log file by itself.
+                std::cerr << e.what() << std::endl;
+            }
+        }
+
+        lock.lock();
+        if (renamed) {
+            // Flush thread may have rotated to another log file while renaming.
+            if (mCurrentLogPath == mNextLogPath) {
+                mCurrentLogPath = takenLogPath;
+            }
+            takenLogPath.clear();
+        }
+        if (nextLogFile) {
+            mpNextLogFile = std::move(nextLogFile);
+        }
+        auto currentLogPath = mCurrentLogPath;
+        lock.unlock();
+        removeExpiredLogFiles(currentLogPath);
+        lock.lock();
+
+        mFileCond.wait_for(lock, DEFAULT_RETENTION_INTERVAL, [this] {
+            return mStopMaintain || !mTakenLogPath.empty() || !mvRetiredLogFiles.empty();
+        });
+    }
+    // Flush thread has exited, so finish the last round at once.
+    mvRetiredLogFiles.clear();
+    std::error_code err;
+    if (!mTakenLogPath.empty()) {
+        takenLogPath = std::exchange(mTakenLogPath, {});
+    }
+    if (!takenLogPath.empty()) {
+        std::filesystem::rename(mNextLogPath, takenLogPath, err);
+        if (!err && mCurrentLogPath == mNextLogPath) {
+            mCurrentLogPath = takenLogPath;
+        }
+    } else if (mpNextLogFile) {
+        // Prepared log file is never used, remove it.
+        mpNextLogFile.reset();
+        std::filesystem::remove(mNextLogPath, err);
+    }
+    auto currentLogPath = mCurrentLogPath;
+    lock.unlock();
+    removeExpiredLogFiles(currentLogPath);
+}
+
+static LogServer& getLogServer() {
     // Every thread can hold only one instance of LogServer
     // Besides, every instance of LogServer would create a new thread as asynchronously-flush thread.
     // TODO: Reduce the use of threads.
     // thread_local static LogServer gLogServer {};
     static LogServer gLogServer {};
+    return gLogServer;
+}
+
+// Sample rates of trace spans, which are set by setTraceSampleRate().
+// TraceSite caches its sample rate until gTraceRateGeneration is changed.
+static std::mutex gTraceRateMutex;
+static std::unordered_map<std::string, uint32_t> gTraceRates;
+static std::atomic<uint32_t> gTraceRateGeneration = 1;
+
+bool trace_sample(TraceSite& site) noexcept {
+    auto generation = gTraceRateGeneration.load(std::memory_order_acquire);
+    [[unlikely]]
+    if (site.generation.load(std::memory_order_relaxed) != generation) {
+        try {
+            std::lock_guard lock { gTraceRateMutex };
+            auto iter = gTraceRates.find(site.name);
+            site.sampleRate.store(iter == gTraceRates.end() ? 1 : iter->second, std::memory_order_relaxed);
+        } catch (...) {
+            // ignore exception, keep the old sample rate.
+        }
+        site.generation.store(generation, std::memory_order_relaxed);
+    }
+    auto rate = site.sampleRate.load(std::memory_order_relaxed);
+    if (rate == 0) {
+        return false;
+    }
+    return site.counter.fetch_add(1, std::memory_order_relaxed) % rate == 0;
+}
+
+int64_t trace_now() noexcept {
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_span(const char* name, int64_t beginUs, int64_t endUs) noexcept {
+#if defined (__linux__) || defined (__unix__) || defined (__ANDROID__)
+    thread_local int tid = gettid();
+#elif defined (__WIN32) || defined(__WIN64) || defined(WIN32)
+    thread_local int tid = GetCurrentThreadId();
+#endif
     try {
-        gLogServer.write(level, fmt, tag);
-        // For fatal case, global dtor would not be invoked, so call the destructor manually to flush log file.
-        [[unlikely]]
-        if (level == LogLevel::Fatal) {
-            auto backtraces = getBacktrace();
-            for (size_t i = 1; i < backtraces.size(); ++i) {
-                gLogServer.write(level, backtraces[i].c_str(), "Backtrace");
-            }
-            gLogServer.forceDestroy();
-            std::terminate();
+        getLogServer().writeTrace(TraceEvent { name, beginUs, endUs, tid });
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::terminate();
+    }
+}
+
+// Append the backtrace of caller to lines, which are written with fatal log line in one group.
+static void append_backtrace(std::string& lines) {
+    if (!lines.empty() && !lines.ends_with('\n')) {
+        lines.push_back('\n');
+    }
+    auto backtraces = getBacktrace();
+    for (size_t i = 1; i < backtraces.size(); ++i) {
+        lines.append(backtraces[i]);
+        if (!lines.ends_with('\n')) {
+            lines.push_back('\n');
         }
-        // For error case, need to flush buffer to log file immediately.
+    }
+}
+
+// Flush or terminate after error and fatal log line is written.
+static void finish_log_level(LogServer& gLogServer, LogLevel level) {
+    // For fatal case, global dtor would not be invoked, so call the destructor manually to flush log file.
+    [[unlikely]]
+    if (level == LogLevel::Fatal) {
+        gLogServer.forceDestroy();
+        std::terminate();
+    }
+    // For error case, need to flush buffer to log file immediately.
+    [[unlikely]]
+    if (level == LogLevel::Error) {
+        gLogServer.forceFlush();
+    }
+}
+
+void format_log_line(LogLevel level, std::string_view fmt, std::string_view tag) noexcept {
+    auto& gLogServer = getLogServer();
+    try {
+        // Fatal log line and its backtrace are written as one group, other threads can't interleave.
         [[unlikely]]
-        if (level == LogLevel::Error) {
-            gLogServer.forceFlush();
+        if (level == LogLevel::Fatal) {
+            std::string lines { fmt };
+            append_backtrace(lines);
+            gLogServer.writeGroup(level, lines, tag);
+        } else {
+            gLogServer.write(level, fmt, tag);
         }
+        finish_log_level(gLogServer, level);
     } catch(const std::exception& e) {
         // Focus on three type of exception:
         // 1. Memeoy out of use: We can't handle this exception, make process abort to notify kernel watchdog!
@@ -397,10 +1419,83 @@ void format_log_line(LogLevel level, std::string_view fmt, std::string_view tag)
     }
 }
 
+void format_log_payload(LogLevel level, PayloadEncoding encoding, const void* data, size_t size
+        , std::string_view fmt, std::string_view tag) noexcept {
+    auto& gLogServer = getLogServer();
+    try {
+        std::string backtrace;
+        [[unlikely]]
+        if (level == LogLevel::Fatal) {
+            append_backtrace(backtrace);
+        }
+        gLogServer.writePayload(level, encoding, data, size, fmt, tag, backtrace);
+        finish_log_level(gLogServer, level);
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::terminate();
+    }
+}
+
+void commit_log_group(LogLevel level, std::string_view lines, std::string_view tag) noexcept {
+    auto& gLogServer = getLogServer();
+    try {
+        [[unlikely]]
+        if (level == LogLevel::Fatal) {
+            std::string group { lines };
+            append_backtrace(group);
+            gLogServer.writeGroup(level, group, tag);
+        } else {
+            gLogServer.writeGroup(level, lines, tag);
+        }
+        finish_log_level(gLogServer, level);
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::terminate();
+    }
+}
+
+// Flush buffered log lines to log file immediately.
+static void flush_log() noexcept {
+    getLogServer().forceFlush();
+}
+
 } // namespace utils::detail
 
 namespace utils {
 
+void dumpFlightRecorder() {
+    try {
+        auto& logServer = detail::getLogServer();
+        logServer.dumpFlightRecorder();
+        logServer.forceFlush();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::terminate();
+    }
+}
+
+void setLogFlushPolicy(std::chrono::milliseconds maxLatency, size_t maxBatch) {
+    detail::getLogServer().setFlushPolicy(maxLatency, maxBatch);
+}
+
+LogStats getLogStats() {
+    return detail::getLogServer().getStats();
+}
+
+void setLogSink(std::string_view address, LogLayoutFormatter layout) {
+    detail::getLogServer().setSink(address, layout);
+}
+
+void setLogFileLayout(LogLayoutFormatter layout) {
+    detail::getLogServer().setFileLayout(layout);
+}
+
+void setTraceSampleRate(std::string_view name, uint32_t rate) {
+    std::lock_guard lock { detail::gTraceRateMutex };
+    detail::gTraceRates[std::string(name)] = rate;
+    detail::gTraceRateGeneration.fetch_add(1, std::memory_order_release);
+}
+
 void assertTrue(bool cond, std::string_view msg) {
 //#ifdef DEBUG_BUILD
 if (!cond) {
@@ -412,14 +1507,17 @@ if (!cond) {
 
 void printBacktrace() {
     auto backtraces = getBacktrace();
-    LOG_WARN("================================================================================");
-    LOG_WARN("============================== Start print backtrace ===========================");
+    LogRecordGroup group { LogLevel::Warning, TAG };
+    group.append("================================================================================");
+    group.append("============================== Start print backtrace ===========================");
     for (size_t i = 1; i < backtraces.size(); ++i) {
-        LOG_WARN(backtraces[i].c_str());
+        group.append(backtraces[i]);
     }
-    LOG_WARN("=============================== End print backtrace  ===========================");
-    // Use LOG_ERR to flush current buffer to log file in last log line.
-    LOG_ERR("================================================================================");
+    group.append("=============================== End print backtrace  ===========================");
+    group.append("================================================================================");
+    group.commit();
+    // Flush the whole backtrace to log file immediately.
+    detail::flush_log();
 }
 
 } // namespace utils
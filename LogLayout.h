@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+namespace utils {
+
+namespace detail {
+
+// Pre-rendered fields of one log line, layout only copies them.
+struct LogLineFields {
+    std::string_view    date;           // "2024-01-31"
+    std::string_view    time;           // "23.59.59"
+    int                 microseconds;
+    std::string_view    pid;            // Right-aligned in 5 columns.
+    std::string_view    tid;            // Right-aligned in 5 columns.
+    std::string_view    level;          // "Info "
+    std::string_view    tag;
+    std::string_view    message;
+};
+
+enum class LayoutFieldType : uint8_t {
+    Literal = 0,
+    Date,           // %D
+    Time,           // %T
+    Microseconds,   // %u
+    Pid,            // %p
+    Tid,            // %t
+    Level,          // %l
+    Tag,            // %g
+    Message,        // %m
+};
+
+// Literal field is the range [begin, begin + size) of pattern.
+struct LayoutField {
+    LayoutFieldType type;
+    size_t          begin;
+    size_t          size;
+};
+
+template <size_t N>
+struct LayoutPattern {
+    consteval LayoutPattern(const char (&pattern)[N]) {
+        std::copy_n(pattern, N, data.begin());
+    }
+
+    constexpr std::string_view view() const {
+        return { data.data(), N - 1 };
+    }
+
+    std::array<char, N> data {};
+};
+
+// Parse pattern to fields, return the count of fields.
+// Unknown field is a compile error, because throw isn't a constant expression.
+template <size_t N>
+constexpr size_t parse_layout(std::string_view pattern, std::array<LayoutField, N>& fields) {
+    size_t count = 0;
+    auto appendLiteral = [&] (size_t begin, size_t size) {
+        // Merge adjacent literals.
+        if (count > 0 && fields[count - 1].type == LayoutFieldType::Literal
+                && fields[count - 1].begin + fields[count - 1].size == begin) {
+            fields[count - 1].size += size;
+        } else {
+            fields[count++] = { LayoutFieldType::Literal, begin, size };
+        }
+    };
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] != '%') {
+            appendLiteral(i, 1);
+            continue;
+        }
+        if (++i == pattern.size()) {
+            throw "Log layout pattern ends with '%'.";
+        }
+        switch (pattern[i]) {
+            case '%': appendLiteral(i, 1); break;
+            case 'D': fields[count++] = { LayoutFieldType::Date, 0, 0 }; break;
+            case 'T': fields[count++] = { LayoutFieldType::Time, 0, 0 }; break;
+            case 'u': fields[count++] = { LayoutFieldType::Microseconds, 0, 0 }; break;
+            case 'p': fields[count++] = { LayoutFieldType::Pid, 0, 0 }; break;
+            case 't': fields[count++] = { LayoutFieldType::Tid, 0, 0 }; break;
+            case 'l': fields[count++] = { LayoutFieldType::Level, 0, 0 }; break;
+            case 'g': fields[count++] = { LayoutFieldType::Tag, 0, 0 }; break;
+            case 'm': fields[count++] = { LayoutFieldType::Message, 0, 0 }; break;
+            default: throw "Unknown field in log layout pattern.";
+        }
+    }
+    return count;
+}
+
+// Write fields to fixed size output, the rest is truncated.
+class LayoutWriter {
+public:
+    LayoutWriter(char* output, size_t size) : mpCursor(output), mpEnd(output + size) {}
+
+    void append(std::string_view str) {
+        auto size = std::min<size_t>(str.size(), mpEnd - mpCursor);
+        ::memcpy(mpCursor, str.data(), size);
+        mpCursor += size;
+    }
+
+    // Write 6 digits with leading zero.
+    void appendMicroseconds(int value) {
+        std::array<char, 6> digits;
+        for (size_t i = digits.size(); i > 0; --i) {
+            digits[i - 1] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        append({ digits.data(), digits.size() });
+    }
+
+    [[nodiscard]]
+    char* cursor() const { return mpCursor; }
+
+private:
+    char*   mpCursor;
+    char*   mpEnd;
+};
+
+// LogLayout is specialized by pattern, such as "%D %T.%u %p %t [%l][%g] %m".
+// Pattern is parsed at compile time, so format() is a fixed sequence of copies.
+template <LayoutPattern Pattern>
+class LogLayout {
+    static constexpr auto parse() {
+        std::array<LayoutField, Pattern.view().size() + 1> fields {};
+        const auto count = parse_layout(Pattern.view(), fields);
+        return std::pair { fields, count };
+    }
+
+    static constexpr auto PARSED = parse();
+
+    static constexpr auto FIELDS = [] {
+        std::array<LayoutField, PARSED.second> fields {};
+        std::copy_n(PARSED.first.begin(), fields.size(), fields.begin());
+        return fields;
+    }();
+
+    template <LayoutField Field>
+    static void writeField(LayoutWriter& writer, const LogLineFields& fields) {
+        if constexpr (Field.type == LayoutFieldType::Literal) {
+            writer.append(Pattern.view().substr(Field.begin, Field.size));
+        } else if constexpr (Field.type == LayoutFieldType::Date) {
+            writer.append(fields.date);
+        } else if constexpr (Field.type == LayoutFieldType::Time) {
+            writer.append(fields.time);
+        } else if constexpr (Field.type == LayoutFieldType::Microseconds) {
+            writer.appendMicroseconds(fields.microseconds);
+        } else if constexpr (Field.type == LayoutFieldType::Pid) {
+            writer.append(fields.pid);
+        } else if constexpr (Field.type == LayoutFieldType::Tid) {
+            writer.append(fields.tid);
+        } else if constexpr (Field.type == LayoutFieldType::Level) {
+            writer.append(fields.level);
+        } else if constexpr (Field.type == LayoutFieldType::Tag) {
+            writer.append(fields.tag);
+        } else {
+            writer.append(fields.message);
+        }
+    }
+
+public:
+    // Write log line ended with '\n' to output, return the length of log line.
+    static size_t format(const LogLineFields& fields, char* output, size_t size) {
+        // Reserve the last character for '\n'.
+        LayoutWriter writer { output, size - 1 };
+        [&] <size_t... I> (std::index_sequence<I...>) {
+            (writeField<FIELDS[I]>(writer, fields), ...);
+        }(std::make_index_sequence<FIELDS.size()>());
+        *writer.cursor() = '\n';
+        return writer.cursor() + 1 - output;
+    }
+};
+
+} // namespace detail
+
+// Format one log line to output, return the length of log line.
+using LogLayoutFormatter = size_t (*)(const detail::LogLineFields& fields, char* output, size_t size);
+
+// Return the formatter of pattern, the fields of pattern are:
+//     %D date, %T time, %u microseconds, %p pid, %t tid, %l level, %g tag, %m message, %% '%'.
+template <detail::LayoutPattern Pattern>
+constexpr LogLayoutFormatter makeLogLayout() {
+    return &detail::LogLayout<Pattern>::format;
+}
+
+} // namespace utils
@@ -0,0 +1,328 @@
+#include "LogSink.h"
+#include "Error.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+extern "C" {
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+
+namespace utils::detail {
+
+using namespace std::chrono;
+
+void encodeFrameHeader(uint32_t size, char* header) {
+    header[0] = static_cast<char>((size >> 24) & 0xff);
+    header[1] = static_cast<char>((size >> 16) & 0xff);
+    header[2] = static_cast<char>((size >> 8) & 0xff);
+    header[3] = static_cast<char>(size & 0xff);
+}
+
+uint32_t decodeFrameHeader(const char* header) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(header);
+    return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16)
+        | (static_cast<uint32_t>(bytes[2]) << 8) | static_cast<uint32_t>(bytes[3]);
+}
+
+SinkAddress parseSinkAddress(std::string_view address) {
+    SinkAddress result {};
+    if (address.starts_with("unix:")) {
+        result.isUnix = true;
+        result.path = address.substr(5);
+        if (result.path.empty() || result.path.size() >= sizeof(sockaddr_un::sun_path)) {
+            throw NormalException("Invalid unix socket path of log sink.", ErrorCode::InvalidArgument);
+        }
+        return result;
+    }
+    if (address.starts_with("tcp:")) {
+        auto hostPort = address.substr(4);
+        auto colon = hostPort.rfind(':');
+        if (colon == std::string_view::npos || colon == 0 || colon + 1 == hostPort.size()) {
+            throw NormalException("Invalid tcp address of log sink.", ErrorCode::InvalidArgument);
+        }
+        result.isUnix = false;
+        result.host = hostPort.substr(0, colon);
+        result.port = hostPort.substr(colon + 1);
+        // Support "[::1]:9000".
+        if (result.host.size() > 2 && result.host.front() == '[' && result.host.back() == ']') {
+            result.host = result.host.substr(1, result.host.size() - 2);
+        }
+        return result;
+    }
+    throw NormalException("Log sink address must start with \"unix:\" or \"tcp:\".", ErrorCode::InvalidArgument);
+}
+
+// Wait until fd is writable, return false if timeout or error happen.
+static bool waitWritable(int fd, milliseconds timeout) {
+    pollfd pollFd { fd, POLLOUT, 0 };
+    int result = 0;
+    do {
+        result = ::poll(&pollFd, 1, static_cast<int>(timeout.count()));
+    } while (result < 0 && errno == EINTR);
+    return result > 0 && (pollFd.revents & (POLLERR | POLLHUP | POLLNVAL)) == 0;
+}
+
+SocketSink::SocketSink(std::string_view address)
+    : mAddress(parseSinkAddress(address))
+    , mpAddrList(nullptr, ::freeaddrinfo)
+    , mNextRetryTime(steady_clock::now())
+    , mRetryDelay(MIN_RETRY_DELAY) {
+    if (mAddress.isUnix) {
+        return ;
+    }
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addrList = nullptr;
+    if (auto error = ::getaddrinfo(mAddress.host.c_str(), mAddress.port.c_str(), &hints, &addrList); error != 0) {
+        throw NormalException("Can't resolve tcp address of log sink: " + std::string(::gai_strerror(error))
+                , ErrorCode::InvalidArgument);
+    }
+    mpAddrList.reset(addrList);
+}
+
+SocketSink::~SocketSink() {}
+
+size_t SocketSink::send(std::span<const std::string_view> frames) {
+    if (frames.empty()) {
+        return 0;
+    }
+    // Collector never send data to us, so readable socket means the connection is closed.
+    if (mpSocket) {
+        char byte = 0;
+        auto result = ::recv(mpSocket->getRawFd(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (result == 0 || (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            disconnect();
+            mNextRetryTime = steady_clock::now();
+        }
+    }
+    if (!connect()) {
+        return 0;
+    }
+
+    std::vector<std::array<char, LOG_FRAME_HEADER_SIZE>> headers(frames.size());
+    std::vector<iovec> iovecs;
+    iovecs.reserve(frames.size() * 2);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        encodeFrameHeader(static_cast<uint32_t>(frames[i].size()), headers[i].data());
+        iovecs.push_back({ headers[i].data(), headers[i].size() });
+        iovecs.push_back({ const_cast<char*>(frames[i].data()), frames[i].size() });
+    }
+
+    const auto deadline = steady_clock::now() + SEND_TIMEOUT;
+    size_t iovIndex = 0;
+    while (iovIndex < iovecs.size()) {
+        msghdr message {};
+        message.msg_iov = iovecs.data() + iovIndex;
+        message.msg_iovlen = std::min<size_t>(iovecs.size() - iovIndex, IOV_MAX);
+        // Same as writev(), but don't raise SIGPIPE if collector is closed.
+        auto result = ::sendmsg(mpSocket->getRawFd(), &message, MSG_NOSIGNAL);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Back-pressure: wait for collector at most SEND_TIMEOUT, and then spill the rest frames.
+            auto now = steady_clock::now();
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && now < deadline
+                    && waitWritable(mpSocket->getRawFd(), duration_cast<milliseconds>(deadline - now))) {
+                continue;
+            }
+            break;
+        }
+        auto sentSize = static_cast<size_t>(result);
+        while (sentSize > 0) {
+            auto& iov = iovecs[iovIndex];
+            if (sentSize >= iov.iov_len) {
+                sentSize -= iov.iov_len;
+                ++iovIndex;
+            } else {
+                iov.iov_base = static_cast<char*>(iov.iov_base) + sentSize;
+                iov.iov_len -= sentSize;
+                sentSize = 0;
+            }
+        }
+    }
+    // The frame may be sent partially, so close the connection and let collector drop it.
+    if (iovIndex < iovecs.size()) {
+        disconnect();
+    }
+    return iovIndex / 2;
+}
+
+bool SocketSink::connect() {
+    if (mpSocket) {
+        return true;
+    }
+    auto now = steady_clock::now();
+    if (now < mNextRetryTime) {
+        return false;
+    }
+    mpSocket = tryConnect();
+    if (mpSocket) {
+        mRetryDelay = MIN_RETRY_DELAY;
+        return true;
+    }
+    mNextRetryTime = now + mRetryDelay;
+    mRetryDelay = std::min(mRetryDelay * 2, MAX_RETRY_DELAY);
+    return false;
+}
+
+std::unique_ptr<FileDesc> SocketSink::tryConnect() {
+    if (mAddress.isUnix) {
+        auto socket = std::make_unique<FileDesc>(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        if (socket->getRawFd() < 0) {
+            return nullptr;
+        }
+        // Failure is treated as unreachable collector, so that frames are spilled.
+        try {
+            socket->setNoBlock();
+        } catch (const std::system_error&) {
+            return nullptr;
+        }
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        ::strncpy(addr.sun_path, mAddress.path.c_str(), sizeof(addr.sun_path) - 1);
+        if (::connect(socket->getRawFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            return nullptr;
+        }
+        return socket;
+    }
+
+    std::unique_ptr<FileDesc> result;
+    for (auto* addr = mpAddrList.get(); addr != nullptr && !result; addr = addr->ai_next) {
+        auto socket = std::make_unique<FileDesc>(::socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol));
+        if (socket->getRawFd() < 0) {
+            continue;
+        }
+        try {
+            socket->setNoBlock();
+        } catch (const std::system_error&) {
+            continue;
+        }
+        if (::connect(socket->getRawFd(), addr->ai_addr, addr->ai_addrlen) < 0) {
+            if (errno != EINPROGRESS || !waitWritable(socket->getRawFd(), CONNECT_TIMEOUT)) {
+                continue;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (::getsockopt(socket->getRawFd(), SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+                continue;
+            }
+        }
+        try {
+            socket->setNoDelay();
+        } catch (const std::system_error&) {
+            continue;
+        }
+        result = std::move(socket);
+    }
+    return result;
+}
+
+void SocketSink::disconnect() {
+    mpSocket.reset();
+}
+
+SpillFile::SpillFile(const std::string& path, size_t maxSize)
+    : mFile(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666)
+    , mMaxSize(maxSize)
+    , mReadOffset(0)
+    , mWriteOffset(0)
+    , mReplayBuffer(REPLAY_CHUNK_SIZE) {
+    // Spill file is owned by one process until it exits, lock it before touching its frames.
+    if (::flock(mFile.getRawFd(), LOCK_EX | LOCK_NB) < 0) {
+        if (errno == EWOULDBLOCK) {
+            throw NormalException("Spill file is used by another process.", ErrorCode::OpNotAllowed);
+        }
+        throw SystemException("Can't lock spill file because:");
+    }
+    // Keep the complete frames left by last process, drop the broken tail.
+    auto fileSize = ::lseek(mFile.getRawFd(), 0, SEEK_END);
+    std::array<char, LOG_FRAME_HEADER_SIZE> header = {};
+    while (mWriteOffset + static_cast<off_t>(header.size()) <= fileSize) {
+        if (::pread(mFile.getRawFd(), header.data(), header.size(), mWriteOffset) != static_cast<ssize_t>(header.size())) {
+            break;
+        }
+        auto frameSize = static_cast<off_t>(header.size() + decodeFrameHeader(header.data()));
+        if (frameSize > static_cast<off_t>(mReplayBuffer.size()) || mWriteOffset + frameSize > fileSize) {
+            break;
+        }
+        mWriteOffset += frameSize;
+    }
+    if (mWriteOffset != fileSize && ::ftruncate(mFile.getRawFd(), mWriteOffset) < 0) {
+        throw SystemException("Can't truncate spill file because:");
+    }
+}
+
+bool SpillFile::append(std::string_view payload) {
+    auto frameSize = LOG_FRAME_HEADER_SIZE + payload.size();
+    if (static_cast<size_t>(mWriteOffset) + frameSize > mMaxSize) {
+        return false;
+    }
+    std::array<char, LOG_FRAME_HEADER_SIZE> header = {};
+    encodeFrameHeader(static_cast<uint32_t>(payload.size()), header.data());
+    std::array<iovec, 2> iovecs = {{
+        { header.data(), header.size() },
+        { const_cast<char*>(payload.data()), payload.size() },
+    }};
+    auto result = ::pwritev(mFile.getRawFd(), iovecs.data(), iovecs.size(), mWriteOffset);
+    // Disk is full or other IO error happen, drop this frame.
+    if (result != static_cast<ssize_t>(frameSize)) {
+        return false;
+    }
+    mWriteOffset += frameSize;
+    return true;
+}
+
+bool SpillFile::replay(SocketSink& sink) {
+    while (!empty()) {
+        auto readSize = std::min<off_t>(mWriteOffset - mReadOffset, mReplayBuffer.size());
+        if (::pread(mFile.getRawFd(), mReplayBuffer.data(), readSize, mReadOffset) != readSize) {
+            return false;
+        }
+        // Only send complete frames in replay buffer, the rest would be read again.
+        std::vector<std::string_view> frames;
+        size_t offset = 0;
+        while (offset + LOG_FRAME_HEADER_SIZE <= static_cast<size_t>(readSize)) {
+            auto payloadSize = decodeFrameHeader(mReplayBuffer.data() + offset);
+            if (offset + LOG_FRAME_HEADER_SIZE + payloadSize > static_cast<size_t>(readSize)) {
+                break;
+            }
+            frames.emplace_back(mReplayBuffer.data() + offset + LOG_FRAME_HEADER_SIZE, payloadSize);
+            offset += LOG_FRAME_HEADER_SIZE + payloadSize;
+        }
+        // Spill file is broken, drop it.
+        if (frames.empty()) {
+            break;
+        }
+        auto sentCount = sink.send(frames);
+        for (size_t i = 0; i < sentCount; ++i) {
+            mReadOffset += LOG_FRAME_HEADER_SIZE + frames[i].size();
+        }
+        if (sentCount < frames.size()) {
+            return false;
+        }
+    }
+    // All frames are sent, reuse spill file from the begining.
+    mReadOffset = 0;
+    mWriteOffset = 0;
+    if (::ftruncate(mFile.getRawFd(), 0) < 0) {
+        throw SystemException("Can't truncate spill file because:");
+    }
+    return true;
+}
+
+} // namespace utils::detail
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "utils.h"
+#include "FileDesc.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+extern "C" {
+#include <netdb.h>
+#include <sys/types.h>
+}
+
+namespace utils::detail {
+
+// Every frame sent to collector is a 4 bytes big-endian length followed by payload.
+constexpr size_t LOG_FRAME_HEADER_SIZE = 4;
+
+void encodeFrameHeader(uint32_t size, char* header);
+
+uint32_t decodeFrameHeader(const char* header);
+
+// SinkAddress is the address of collector, such as "unix:/tmp/log.sock" or "tcp:127.0.0.1:9000".
+struct SinkAddress {
+    bool        isUnix;
+    std::string path;
+    std::string host;
+    std::string port;
+};
+
+// Throw NormalException if address is invalid.
+auto parseSinkAddress(std::string_view address) -> SinkAddress;
+
+// SocketSink send log buffers to collector as length-prefixed frames.
+// Not thread-safety!
+class SocketSink {
+    DISABLE_COPY(SocketSink);
+    DISABLE_MOVE(SocketSink);
+public:
+    // Host of tcp address is resolved once here, flush thread never blocks on DNS when reconnecting.
+    // Throw NormalException if address is invalid or host can't be resolved.
+    explicit SocketSink(std::string_view address);
+
+    ~SocketSink();
+
+    // Send frames to collector, return the count of frames which are sent completely.
+    // If collector is unreachable or too slow, the connection is closed and it would be
+    // reconnected with backoff, so the frames which are not sent should be spilled.
+    size_t send(std::span<const std::string_view> frames);
+
+    [[nodiscard]]
+    bool connected() const { return mpSocket != nullptr; }
+
+private:
+    // Connect to collector if the backoff time is passed.
+    bool connect();
+
+    // Return nullptr if collector is unreachable.
+    auto tryConnect() -> std::unique_ptr<FileDesc>;
+
+    void disconnect();
+
+    static constexpr auto CONNECT_TIMEOUT = std::chrono::milliseconds(100);
+    static constexpr auto SEND_TIMEOUT = std::chrono::milliseconds(100);
+    static constexpr auto MIN_RETRY_DELAY = std::chrono::milliseconds(100);
+    static constexpr auto MAX_RETRY_DELAY = std::chrono::milliseconds(10000);
+
+    SinkAddress                 mAddress;
+    // Resolved addresses of tcp host, nullptr for unix socket.
+    std::unique_ptr<addrinfo, decltype(&::freeaddrinfo)>
+                                mpAddrList;
+    std::unique_ptr<FileDesc>   mpSocket;
+    std::chrono::steady_clock::time_point
+                                mNextRetryTime;
+    std::chrono::milliseconds   mRetryDelay;
+};
+
+// SpillFile keeps the frames which can't be sent to collector, in the same frame format.
+// The complete frames which are left by last process would be replayed too.
+// Not thread-safety!
+class SpillFile {
+    DISABLE_COPY(SpillFile);
+    DISABLE_MOVE(SpillFile);
+public:
+    // Spill file is locked until it's destroyed.
+    // Throw NormalException if it's locked by another process.
+    SpillFile(const std::string& path, size_t maxSize);
+
+    ~SpillFile() {}
+
+    // Return false if spill file is full, the frame is dropped.
+    bool append(std::string_view payload);
+
+    // Send spilled frames to collector from the oldest one.
+    // Return true if all spilled frames are sent.
+    bool replay(SocketSink& sink);
+
+    [[nodiscard]]
+    bool empty() const { return mReadOffset == mWriteOffset; }
+
+private:
+    static constexpr size_t REPLAY_CHUNK_SIZE = 64 * 1024;
+
+    FileDesc            mFile;
+    size_t              mMaxSize;
+    off_t               mReadOffset;
+    off_t               mWriteOffset;
+    std::vector<char>   mReplayBuffer;
+};
+
+} // namespace utils::detail
@@ -0,0 +1,276 @@
+#include "Profiler.h"
+#include "Backtrace.h"
+#include "Error.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+extern "C" {
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+}
+
+namespace utils::detail {
+
+using namespace std::chrono;
+
+// Threads are sharded by tid, so that threads rarely share a sample ring.
+constexpr size_t PROFILER_SHARD_COUNT = 16;
+// Must be power of 2.
+constexpr size_t PROFILER_RING_SIZE = 256;
+// Frames of signal handler and signal trampoline, which are skipped.
+constexpr size_t PROFILER_HANDLER_DEPTH = 2;
+
+struct ProfileSample {
+    size_t  depth;
+    std::array<void*, PROFILER_MAX_DEPTH + PROFILER_HANDLER_DEPTH + 1>
+            pcs;
+};
+
+// Single producer single consumer ring of samples. The signal handler which owns "busy" is the
+// producer, and the aggregate thread is the consumer.
+struct alignas(64) SampleShard {
+    std::atomic<bool>       busy;
+    std::atomic<uint64_t>   head;
+    std::atomic<uint64_t>   tail;
+    std::array<ProfileSample, PROFILER_RING_SIZE>
+                            samples;
+};
+
+// Use static storage, so that signal handler never touches freed memory.
+static std::array<SampleShard, PROFILER_SHARD_COUNT> gSampleShards;
+static std::atomic<bool> gSampling;
+static std::atomic<uint64_t> gDroppedSamples;
+
+// Only async-signal-safety functions can be called here.
+static void onProfileSignal(int) {
+    if (!gSampling.load(std::memory_order_acquire)) {
+        return ;
+    }
+    const int savedErrno = errno;
+    auto& shard = gSampleShards[static_cast<size_t>(::syscall(SYS_gettid)) % PROFILER_SHARD_COUNT];
+    // Another thread of this shard is sampling, drop this sample instead of waiting.
+    if (shard.busy.exchange(true, std::memory_order_acquire)) {
+        gDroppedSamples.fetch_add(1, std::memory_order_relaxed);
+        errno = savedErrno;
+        return ;
+    }
+    auto head = shard.head.load(std::memory_order_relaxed);
+    if (head - shard.tail.load(std::memory_order_acquire) < PROFILER_RING_SIZE) {
+        auto& sample = shard.samples[head & (PROFILER_RING_SIZE - 1)];
+        sample.depth = captureBacktrace(sample.pcs.data(), sample.pcs.size());
+        shard.head.store(head + 1, std::memory_order_release);
+    } else {
+        gDroppedSamples.fetch_add(1, std::memory_order_relaxed);
+    }
+    shard.busy.store(false, std::memory_order_release);
+    errno = savedErrno;
+}
+
+class Profiler {
+    DISABLE_COPY(Profiler);
+    DISABLE_MOVE(Profiler);
+public:
+    Profiler(std::string_view path, int frequency, seconds dumpInterval);
+
+    ~Profiler();
+
+private:
+    // Stop profile timer and restore SIGPROF handler.
+    void stopSampling();
+
+    // Aggregate samples, and rewrite folded stacks file every mDumpInterval.
+    void doAggregateAsync();
+
+    // Move samples from rings to mFoldedStacks. Call by aggregate thread.
+    void drainSamples();
+
+    // Rewrite folded stacks file by rename(), so that reader never sees half of file.
+    // Call by aggregate thread.
+    void dumpFoldedStacks();
+
+    static constexpr auto AGGREGATE_INTERVAL = milliseconds(100);
+
+    std::string             mPath;
+    seconds                 mDumpInterval;
+    struct sigaction        mOldAction;
+
+    std::mutex              mMutex;
+    std::condition_variable mCond;
+    bool                    mStopThread;
+    std::thread             mAggregateThread;
+
+    std::unordered_map<void*, std::string>
+                            mSymbolCache;
+    std::unordered_map<std::string, uint64_t>
+                            mFoldedStacks;
+};
+
+Profiler::Profiler(std::string_view path, int frequency, seconds dumpInterval)
+    : mPath(path)
+    , mDumpInterval(dumpInterval)
+    , mOldAction()
+    , mStopThread(false) {
+    // setitimer() can't sample faster than the tick of kernel.
+    if (frequency <= 0 || frequency > 1000) {
+        throw NormalException("Frequency of profiler must be in [1, 1000].", ErrorCode::InvalidArgument);
+    }
+    // The first call of backtrace() loads the unwinder, which isn't async-signal-safety.
+    std::array<void*, 2> warmup;
+    captureBacktrace(warmup.data(), warmup.size());
+    gDroppedSamples = 0;
+    for (auto& shard: gSampleShards) {
+        shard.tail = shard.head.load();
+    }
+
+    struct sigaction action {};
+    action.sa_handler = onProfileSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (::sigaction(SIGPROF, &action, &mOldAction) < 0) {
+        throw SystemException("Can't install SIGPROF handler because:");
+    }
+    gSampling = true;
+
+    // tv_usec must be less than 1 second, so 1 Hz is 1 second and 0 microseconds.
+    const auto interval = microseconds(1000 * 1000 / frequency);
+    itimerval timer {};
+    timer.it_interval.tv_sec = duration_cast<seconds>(interval).count();
+    timer.it_interval.tv_usec = (interval % seconds(1)).count();
+    timer.it_value = timer.it_interval;
+    if (::setitimer(ITIMER_PROF, &timer, nullptr) < 0) {
+        SystemException exception { "Can't start profile timer because:" };
+        stopSampling();
+        throw exception;
+    }
+    try {
+        mAggregateThread = std::thread { &Profiler::doAggregateAsync, this };
+    } catch (...) {
+        stopSampling();
+        throw;
+    }
+}
+
+Profiler::~Profiler() {
+    stopSampling();
+    {
+        std::lock_guard lock { mMutex };
+        mStopThread = true;
+    }
+    mCond.notify_one();
+    mAggregateThread.join();
+}
+
+void Profiler::stopSampling() {
+    itimerval timer {};
+    ::setitimer(ITIMER_PROF, &timer, nullptr);
+    gSampling = false;
+    // The default action of SIGPROF is terminating process, so ignore the signal which is still pending.
+    if (mOldAction.sa_handler == SIG_DFL) {
+        mOldAction.sa_handler = SIG_IGN;
+    }
+    ::sigaction(SIGPROF, &mOldAction, nullptr);
+}
+
+void Profiler::doAggregateAsync() {
+    auto nextDumpTime = steady_clock::now() + mDumpInterval;
+    while (true) {
+        {
+            std::unique_lock lock { mMutex };
+            mCond.wait_for(lock, AGGREGATE_INTERVAL, [&] { return mStopThread; });
+            if (mStopThread) {
+                break;
+            }
+        }
+        drainSamples();
+        if (steady_clock::now() >= nextDumpTime) {
+            dumpFoldedStacks();
+            nextDumpTime = steady_clock::now() + mDumpInterval;
+        }
+    }
+    // Handler is uninstalled, so all samples are in rings.
+    drainSamples();
+    dumpFoldedStacks();
+}
+
+void Profiler::drainSamples() {
+    std::string stack;
+    for (auto& shard: gSampleShards) {
+        auto tail = shard.tail.load(std::memory_order_relaxed);
+        const auto head = shard.head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) {
+            const auto& sample = shard.samples[tail & (PROFILER_RING_SIZE - 1)];
+            // Folded stack is "root;...;leaf", from the outermost frame.
+            stack.clear();
+            for (auto i = sample.depth; i > PROFILER_HANDLER_DEPTH; --i) {
+                auto* pc = sample.pcs[i - 1];
+                auto iter = mSymbolCache.find(pc);
+                if (iter == mSymbolCache.end()) {
+                    iter = mSymbolCache.emplace(pc, symbolize(pc)).first;
+                    // ';' is the separator of frames.
+                    std::replace(iter->second.begin(), iter->second.end(), ';', ':');
+                }
+                if (!stack.empty()) {
+                    stack.push_back(';');
+                }
+                stack.append(iter->second);
+            }
+            if (!stack.empty()) {
+                ++mFoldedStacks[stack];
+            }
+        }
+        shard.tail.store(tail, std::memory_order_release);
+    }
+}
+
+void Profiler::dumpFoldedStacks() {
+    auto tmpPath = mPath + ".tmp";
+    {
+        std::ofstream output { tmpPath, std::ios::out | std::ios::trunc };
+        if (!output.is_open()) {
+            return ;
+        }
+        for (auto& [stack, count]: mFoldedStacks) {
+            output << stack << ' ' << count << '\n';
+        }
+        if (auto dropped = gDroppedSamples.load(std::memory_order_relaxed); dropped > 0) {
+            output << "[dropped] " << dropped << '\n';
+        }
+    }
+    ::rename(tmpPath.c_str(), mPath.c_str());
+}
+
+static std::mutex gProfilerMutex;
+static std::unique_ptr<Profiler> gpProfiler;
+
+} // namespace utils::detail
+
+namespace utils {
+
+void startProfiler(std::string_view path, int frequency, std::chrono::seconds dumpInterval) {
+    std::lock_guard lock { detail::gProfilerMutex };
+    if (detail::gpProfiler) {
+        throw NormalException("Profiler is running.", ErrorCode::OpNotAllowed);
+    }
+    detail::gpProfiler = std::make_unique<detail::Profiler>(path, frequency, dumpInterval);
+}
+
+void stopProfiler() {
+    std::lock_guard lock { detail::gProfilerMutex };
+    detail::gpProfiler.reset();
+}
+
+} // namespace utils
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <string_view>
+
+// Default sampling frequency of CPU profiler, in Hz.
+#ifndef PROFILER_DEFAULT_FREQUENCY
+#define PROFILER_DEFAULT_FREQUENCY 100
+#endif
+
+// Default interval of rewriting folded stacks file, in seconds.
+#ifndef PROFILER_DUMP_INTERVAL
+#define PROFILER_DUMP_INTERVAL 60
+#endif
+
+// Max depth of sampled stack.
+#ifndef PROFILER_MAX_DEPTH
+#define PROFILER_MAX_DEPTH 32
+#endif
+
+namespace utils {
+
+// Sample the CPU time of the whole process by SIGPROF. The folded stacks, which can be rendered
+// by flamegraph.pl, are rewritten to path every dumpInterval.
+// The real frequency is limited by the tick of kernel, such as 250 Hz.
+// Build with -rdynamic to get the names of functions in executable.
+// Throw NormalException if profiler is running or frequency is invalid.
+// Thread-safety.
+void startProfiler(std::string_view path, int frequency = PROFILER_DEFAULT_FREQUENCY
+        , std::chrono::seconds dumpInterval = std::chrono::seconds(PROFILER_DUMP_INTERVAL));
+
+// Stop sampling and write the folded stacks at last.
+// Thread-safety.
+void stopProfiler();
+
+} // namespace utils
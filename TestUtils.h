@@ -0,0 +1,81 @@
+#pragma once
+
+// Helpers shared by the standalone test programs.
+
+#include "utils.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string_view>
+#include <system_error>
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+namespace utils::test {
+
+// Print the message and exit if cond isn't satisfied.
+inline void check(bool cond, std::string_view msg) {
+    if (!cond) {
+        std::cerr << "[FAILED] " << msg << std::endl;
+        std::exit(1);
+    }
+}
+
+// Run func in child process, and return the pid without waiting for it.
+// Log server of child is destroyed by exit(), so its log and trace files are completed.
+inline pid_t forkChild(const std::function<void()>& func) {
+    auto pid = ::fork();
+    check(pid >= 0, "fork");
+    if (pid == 0) {
+        func();
+        std::exit(0);
+    }
+    return pid;
+}
+
+// Wait for child process, and return its wait status.
+inline int waitChild(pid_t pid) {
+    int status = 0;
+    check(::waitpid(pid, &status, 0) == pid, "waitpid");
+    return status;
+}
+
+// Wait for child process, and check that it exits normally.
+inline void waitChildExit(pid_t pid) {
+    auto status = waitChild(pid);
+    check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "child process exits normally");
+}
+
+// Run func in child process until it exits normally. Return the pid of child.
+inline pid_t runChild(const std::function<void()>& func) {
+    auto pid = forkChild(func);
+    waitChildExit(pid);
+    return pid;
+}
+
+// Remove the directory when test starts, and remove it again when test passes.
+// A failed test exits without unwinding, so its files are kept for debugging.
+class TempDir {
+    DISABLE_COPY(TempDir);
+    DISABLE_MOVE(TempDir);
+public:
+    explicit TempDir(std::string_view path) : mPath(path) {
+        std::filesystem::remove_all(mPath);
+    }
+
+    ~TempDir() {
+        std::error_code ignored;
+        std::filesystem::remove_all(mPath, ignored);
+    }
+
+private:
+    std::filesystem::path mPath;
+};
+
+} // namespace utils::test
@@ -0,0 +1,56 @@
+#include "Encode.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace utils;
+
+using EncodeFunc = size_t (*)(const uint8_t*, size_t, char*);
+
+// Print the throughput of kernel in MB/s of input.
+static void bench(std::string_view name, EncodeFunc func, const std::string& data, size_t size) {
+    std::string output(base64EncodedSize(size) + hexEncodedSize(size), '\0');
+    const size_t rounds = (256 << 20) / size;
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+        checksum += func(reinterpret_cast<const uint8_t*>(data.data()), size, output.data());
+        checksum += output[i % output.size()];
+    }
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-16s %6zu bytes: %9.1f MB/s (checksum %zu)\n"
+            , name.data(), size, static_cast<double>(rounds * size) / seconds / (1 << 20), checksum);
+}
+
+int main() {
+    std::mt19937 random { 20240101 };
+    std::string data(64 * 1024, '\0');
+    for (auto& c: data) {
+        c = static_cast<char>(random());
+    }
+    for (size_t size: { 64, 1024, 64 * 1024 }) {
+        bench("hex scalar", detail::hexEncodeScalar, data, size);
+#if defined (__x86_64__) || defined (__i386__)
+        if (detail::cpuSupportsSsse3()) {
+            bench("hex ssse3", detail::hexEncodeSsse3, data, size);
+        }
+        if (detail::cpuSupportsAvx2()) {
+            bench("hex avx2", detail::hexEncodeAvx2, data, size);
+        }
+#endif
+        bench("base64 scalar", detail::base64EncodeScalar, data, size);
+#if defined (__x86_64__) || defined (__i386__)
+        if (detail::cpuSupportsSsse3()) {
+            bench("base64 ssse3", detail::base64EncodeSsse3, data, size);
+        }
+        if (detail::cpuSupportsAvx2()) {
+            bench("base64 avx2", detail::base64EncodeAvx2, data, size);
+        }
+#endif
+    }
+    return 0;
+}
@@ -0,0 +1,28 @@
+#include "LogCollector.h"
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+
+// A local stand-in of log collector, which prints the log lines received from setLogSink().
+// Usage: collector unix:/path/to/socket | tcp:host:port
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " unix:/path/to/socket | tcp:host:port" << std::endl;
+        return 1;
+    }
+    try {
+        utils::LogCollector collector { argv[1] };
+        while (true) {
+            collector.poll(std::chrono::milliseconds(1000), [] (std::string_view frame) {
+                fwrite(frame.data(), 1, frame.size(), stdout);
+                fflush(stdout);
+            });
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -10,6 +10,8 @@
 
 using namespace utils;
 
+static constexpr std::string_view TAG = "Test";
+
 int main() {
     std::vector<std::jthread> threadVec;
     for (int i = 0; i != 5; ++i) {
@@ -0,0 +1,78 @@
+#include "Encode.h"
+#include "TestUtils.h"
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace utils;
+using namespace utils::test;
+
+using EncodeFunc = size_t (*)(const uint8_t*, size_t, char*);
+
+static std::string encode(EncodeFunc func, std::string_view src, size_t encodedSize) {
+    std::string result(encodedSize, '\0');
+    auto size = func(reinterpret_cast<const uint8_t*>(src.data()), src.size(), result.data());
+    check(size == encodedSize, "Encoded size is wrong");
+    return result;
+}
+
+// Check scalar kernels by known vectors.
+static void testScalar() {
+    check(encode(detail::hexEncodeScalar, "", 0) == "", "hex of empty string");
+    check(encode(detail::hexEncodeScalar, "\x01\xab\xff", 6) == "01abff", "hex of bytes");
+    const std::vector<std::pair<std::string_view, std::string_view>> vectors = {
+        { "", "" }, { "f", "Zg==" }, { "fo", "Zm8=" }, { "foo", "Zm9v" },
+        { "foob", "Zm9vYg==" }, { "fooba", "Zm9vYmE=" }, { "foobar", "Zm9vYmFy" },
+        { "\xff\xfe\xfd", "//79" },
+    };
+    for (const auto& [src, expected]: vectors) {
+        check(encode(detail::base64EncodeScalar, src, base64EncodedSize(src.size())) == expected
+                , "base64 of " + std::string(src));
+    }
+}
+
+// SIMD kernels must produce the same output as scalar kernels for every size and alignment.
+static void testKernels() {
+    std::mt19937 random { 20240101 };
+    std::string data(1024 + 64, '\0');
+    for (auto& c: data) {
+        c = static_cast<char>(random());
+    }
+    std::vector<std::pair<std::string_view, EncodeFunc>> hexKernels = { { "dispatch", hexEncode } };
+    std::vector<std::pair<std::string_view, EncodeFunc>> base64Kernels = { { "dispatch", base64Encode } };
+#if defined (__x86_64__) || defined (__i386__)
+    if (detail::cpuSupportsSsse3()) {
+        hexKernels.emplace_back("ssse3", detail::hexEncodeSsse3);
+        base64Kernels.emplace_back("ssse3", detail::base64EncodeSsse3);
+    }
+    if (detail::cpuSupportsAvx2()) {
+        hexKernels.emplace_back("avx2", detail::hexEncodeAvx2);
+        base64Kernels.emplace_back("avx2", detail::base64EncodeAvx2);
+    }
+#endif
+    for (size_t offset = 0; offset < 8; ++offset) {
+        for (size_t size = 0; size <= 1024; ++size) {
+            auto src = std::string_view(data).substr(offset, size);
+            auto hex = encode(detail::hexEncodeScalar, src, hexEncodedSize(size));
+            auto base64 = encode(detail::base64EncodeScalar, src, base64EncodedSize(size));
+            for (const auto& [name, func]: hexKernels) {
+                check(encode(func, src, hexEncodedSize(size)) == hex
+                        , "hex kernel " + std::string(name) + " size " + std::to_string(size));
+            }
+            for (const auto& [name, func]: base64Kernels) {
+                check(encode(func, src, base64EncodedSize(size)) == base64
+                        , "base64 kernel " + std::string(name) + " size " + std::to_string(size));
+            }
+        }
+    }
+}
+
+int main() {
+    testScalar();
+    testKernels();
+    std::cout << "[PASSED] test_encode" << std::endl;
+    return 0;
+}
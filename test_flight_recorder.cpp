@@ -0,0 +1,82 @@
+#include "Log.h"
+#include "TestUtils.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Built with LOG_FLIGHT_RECORDER_LEVEL=3 and LOG_FLIGHT_RECORDER_SIZE=8, so that debug and
+// info lines are kept in flight recorder, and warning lines are written to log file.
+
+using namespace utils;
+using namespace utils::test;
+
+static constexpr std::string_view TAG = "FlightTest";
+static constexpr std::string_view BACKFILL_PREFIX = "[Backfill] ";
+
+static void writeLines() {
+    // Ring is wrapped, only the latest 8 lines are kept.
+    for (int i = 0; i < 20; ++i) {
+        LOG_INFO("recorded %d", i);
+    }
+    LOG_WARN("warning 0");
+    LOG_ERR("error 0");
+    // Ring is cleared by the last backfill.
+    for (int i = 20; i < 23; ++i) {
+        LOG_DEBUG("recorded %d", i);
+    }
+    LOG_ERR("error 1");
+    LOG_ERR("error 2");
+    LOG_DEBUG("dumped 0");
+    LOG_INFO("dumped 1");
+    dumpFlightRecorder();
+    // Never written, because no error happens after it.
+    LOG_INFO("dropped");
+}
+
+int main() {
+    TempDir logDir { DEFAULT_LOG_PATH };
+    runChild(writeLines);
+
+    // Messages of log lines, backfill lines are marked with prefix.
+    std::vector<std::string> messages;
+    const auto tagField = "[" + std::string(TAG) + "] ";
+    int logFileCount = 0;
+    for (const auto& entry: std::filesystem::directory_iterator(DEFAULT_LOG_PATH)) {
+        if (entry.path().extension() != ".log") {
+            continue;
+        }
+        ++logFileCount;
+        std::ifstream input { entry.path() };
+        std::string line;
+        while (std::getline(input, line)) {
+            auto pos = line.find(tagField);
+            check(pos != std::string::npos, "unexpected line: " + line);
+            auto message = line.substr(pos + tagField.size());
+            messages.push_back(line.starts_with(BACKFILL_PREFIX) ? "B " + message : message);
+        }
+    }
+    check(logFileCount == 1, "only one log file");
+
+    std::vector<std::string> expected = { "warning 0" };
+    for (int i = 12; i < 20; ++i) {
+        expected.push_back("B recorded " + std::to_string(i));
+    }
+    expected.push_back("error 0");
+    for (int i = 20; i < 23; ++i) {
+        expected.push_back("B recorded " + std::to_string(i));
+    }
+    expected.push_back("error 1");
+    expected.push_back("error 2");
+    expected.push_back("B dumped 0");
+    expected.push_back("B dumped 1");
+
+    check(messages.size() == expected.size(), "count of log lines: " + std::to_string(messages.size()));
+    for (size_t i = 0; i < expected.size(); ++i) {
+        check(messages[i] == expected[i], "expect \"" + expected[i] + "\", but \"" + messages[i] + "\"");
+    }
+    std::cout << "[PASSED] test_flight_recorder" << std::endl;
+    return 0;
+}
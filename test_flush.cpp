@@ -0,0 +1,93 @@
+#include "Log.h"
+#include "TestUtils.h"
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace utils;
+using namespace utils::test;
+using namespace std::chrono_literals;
+
+static constexpr std::string_view TAG = "FlushTest";
+// Same as the size of LogBuffer.
+static constexpr uint64_t LOG_BUFFER_SIZE = 4096;
+
+// Return false if cond isn't satisfied before timeout.
+static bool waitFor(const std::function<bool()>& cond, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(1ms);
+    }
+    return true;
+}
+
+static void testIdle() {
+    setLogFlushPolicy(200ms, 4);
+    auto before = getLogStats();
+    LOG_INFO("flush-test idle");
+    check(waitFor([&] { return getLogStats().writes > before.writes; }, 2s), "Log line is flushed after max latency.");
+    // Let flush thread go to sleep.
+    std::this_thread::sleep_for(100ms);
+
+    // Nothing is buffered, so flush thread never wakes up.
+    before = getLogStats();
+    std::this_thread::sleep_for(1s);
+    auto after = getLogStats();
+    check(after.wakeups == before.wakeups, "Flush thread wakes up while idle: " + std::to_string(after.wakeups - before.wakeups));
+    check(after.writes == before.writes, "Flush thread writes while idle.");
+}
+
+static void testBurst() {
+    // Latency is long enough, so only full batches are flushed during the burst.
+    setLogFlushPolicy(10s, 4);
+    std::this_thread::sleep_for(100ms);
+    auto before = getLogStats();
+    for (int i = 0; i < 10000; ++i) {
+        LOG_INFO("flush-test burst %d", i);
+    }
+    // Flush thread may be still writing the last batch.
+    std::this_thread::sleep_for(200ms);
+    auto after = getLogStats();
+    auto writes = after.writes - before.writes;
+    auto writtenBytes = after.writtenBytes - before.writtenBytes;
+    check(writes > 0, "Full batches are flushed before max latency.");
+    // Every write contains a batch of 4 nearly full buffers at least.
+    auto maxWrites = writtenBytes / (4 * (LOG_BUFFER_SIZE - LOG_MAX_LINE_SIZE)) + 1;
+    check(writes <= maxWrites, "Burst isn't batched: " + std::to_string(writes) + " writes of " + std::to_string(writtenBytes) + " bytes.");
+    check(after.wakeups - before.wakeups <= 2 * writes + 2, "Flush thread wakes up too often during burst.");
+}
+
+static void testError() {
+    setLogFlushPolicy(10s, 1000);
+    std::this_thread::sleep_for(100ms);
+    // Flush the rest of burst.
+    LOG_ERR("flush-test error 0");
+    std::this_thread::sleep_for(100ms);
+
+    auto before = getLogStats();
+    LOG_INFO("flush-test pending");
+    std::this_thread::sleep_for(300ms);
+    check(getLogStats().writes == before.writes, "Log line is flushed before max latency.");
+    auto begin = std::chrono::steady_clock::now();
+    LOG_ERR("flush-test error 1");
+    check(waitFor([&] { return getLogStats().writes > before.writes; }, 1s), "LOG_ERR isn't flushed immediately.");
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+    std::cout << "LOG_ERR is flushed in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() << "us" << std::endl;
+}
+
+int main() {
+    TempDir logDir { DEFAULT_LOG_PATH };
+    testIdle();
+    testBurst();
+    testError();
+    check(getLogStats().droppedFrames == 0, "No frame is dropped.");
+    std::cout << "[PASSED] test_flush" << std::endl;
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include "Log.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace utils;
+using namespace utils::test;
+
+static constexpr std::string_view TAG = "GroupTest";
+static constexpr int GROUP_COUNT = 50;
+// Every group is about 7 KB, which spans two LogBuffers at least.
+static constexpr int GROUP_LINE_COUNT = 80;
+static constexpr int NOISE_THREAD_COUNT = 2;
+
+static void startNoise(std::atomic<bool>& stop, std::vector<std::thread>& threads) {
+    for (int i = 0; i < NOISE_THREAD_COUNT; ++i) {
+        threads.emplace_back([&stop] {
+            for (int j = 0; !stop.load(std::memory_order_relaxed); ++j) {
+                LOG_INFO("noise %d", j);
+            }
+        });
+    }
+}
+
+static void writeLines() {
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> threads;
+    startNoise(stop, threads);
+    for (int i = 0; i < GROUP_COUNT; ++i) {
+        LogRecordGroup group { LogLevel::Info, TAG };
+        for (int j = 0; j < GROUP_LINE_COUNT; ++j) {
+            group.appendf("group %d line %d", i, j);
+        }
+    }
+    stop = true;
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    // The last line isn't terminated by '\n', but it's still a whole line.
+    detail::commit_log_group(LogLevel::Info, "unterminated 0\nunterminated 1\nunterminated last", TAG);
+}
+
+static void writeFatal() {
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> threads;
+    startNoise(stop, threads);
+    // Let noise threads run, process is aborted while they are still writing.
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    LOG_FATAL("fatal line");
+}
+
+// Log files are named by time and sequence, read them in order.
+static std::vector<std::string> readLines() {
+    std::vector<std::filesystem::path> logFiles;
+    for (const auto& entry: std::filesystem::directory_iterator(DEFAULT_LOG_PATH)) {
+        if (entry.path().extension() == ".log") {
+            logFiles.push_back(entry.path());
+        }
+    }
+    std::sort(logFiles.begin(), logFiles.end());
+    std::vector<std::string> lines;
+    for (const auto& logFile: logFiles) {
+        std::ifstream input { logFile };
+        std::string line;
+        while (std::getline(input, line)) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+static void checkGroups() {
+    auto lines = readLines();
+    const auto tagField = "[" + std::string(TAG) + "] ";
+    int groupCount = 0;
+    int noiseCount = 0;
+    std::vector<std::string> unterminated;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        auto pos = lines[i].find(tagField);
+        check(pos != std::string::npos, "unexpected line: " + lines[i]);
+        auto message = lines[i].substr(pos + tagField.size());
+        if (message.starts_with("unterminated ")) {
+            unterminated.push_back(message);
+            continue;
+        }
+        int group = 0;
+        int index = 0;
+        if (sscanf(message.c_str(), "group %d line %d", &group, &index) != 2) {
+            check(message.starts_with("noise "), "unexpected line: " + lines[i]);
+            ++noiseCount;
+            continue;
+        }
+        // The first line of group is found, the rest lines must follow it without interleaving.
+        check(index == 0, "group is interleaved: " + lines[i]);
+        check(group == groupCount, "groups are out of order: " + lines[i]);
+        check(i + GROUP_LINE_COUNT <= lines.size(), "group is incomplete");
+        const auto prefix = lines[i].substr(0, pos);
+        for (int j = 0; j < GROUP_LINE_COUNT; ++j) {
+            const auto& line = lines[i + j];
+            auto expected = "group " + std::to_string(group) + " line " + std::to_string(j);
+            check(line.ends_with(tagField + expected), "expect \"" + expected + "\", but \"" + line + "\"");
+            // All lines of group share one timestamp.
+            check(line.starts_with(prefix), "group has different timestamps: " + line);
+        }
+        i += GROUP_LINE_COUNT - 1;
+        ++groupCount;
+    }
+    check(groupCount == GROUP_COUNT, "count of groups: " + std::to_string(groupCount));
+    check(noiseCount > 0, "other threads write while groups are committed");
+    check(unterminated == std::vector<std::string> { "unterminated 0", "unterminated 1", "unterminated last" }
+            , "last line of unterminated group is changed");
+}
+
+static void checkFatal() {
+    auto lines = readLines();
+    const auto fatalField = "[" + std::string(TAG) + "] fatal line";
+    auto fatal = std::find_if(lines.begin(), lines.end(), [&](const auto& line) { return line.ends_with(fatalField); });
+    check(fatal != lines.end(), "fatal line is written");
+    // Backtrace follows fatal line without interleaving, and shares its timestamp, level and tag.
+    const auto prefix = fatal->substr(0, fatal->size() - fatalField.size());
+    auto end = std::find_if(fatal + 1, lines.end(), [&](const auto& line) { return !line.starts_with(prefix); });
+    check(end - fatal > 1, "backtrace follows fatal line");
+    for (auto it = end; it != lines.end(); ++it) {
+        check(!it->starts_with(prefix), "backtrace is interleaved: " + *it);
+    }
+}
+
+int main() {
+    {
+        TempDir logDir { DEFAULT_LOG_PATH };
+        runChild(writeLines);
+        checkGroups();
+    }
+    {
+        TempDir logDir { DEFAULT_LOG_PATH };
+        auto status = waitChild(forkChild(writeFatal));
+        check(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT, "child process is aborted by fatal line");
+        checkFatal();
+    }
+    std::cout << "[PASSED] test_group" << std::endl;
+    return 0;
+}
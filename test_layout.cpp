@@ -0,0 +1,47 @@
+#include "LogLayout.h"
+#include "TestUtils.h"
+
+#include <array>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+using namespace utils;
+using namespace utils::test;
+
+static std::string format(LogLayoutFormatter layout, const detail::LogLineFields& fields, size_t size = 512) {
+    std::string output(size, '\0');
+    output.resize(layout(fields, output.data(), output.size()));
+    return output;
+}
+
+int main() {
+    detail::LogLineFields fields {
+        .date = "2024-01-31",
+        .time = "23.59.59",
+        .microseconds = 4021,
+        .pid = "  123",
+        .tid = "12345",
+        .level = "Info ",
+        .tag = "Test",
+        .message = "hello",
+    };
+
+    // Default layout is the same as the old snprintf() format.
+    std::array<char, 512> expected;
+    snprintf(expected.data(), expected.size(), "%04d-%02d-%02d %02d.%02d.%02d.%06d %5d %5d [%s][%s] %s\n"
+            , 2024, 1, 31, 23, 59, 59, 4021, 123, 12345, "Info ", "Test", "hello");
+    check(format(makeLogLayout<"%D %T.%u %p %t [%l][%g] %m">(), fields) == expected.data(), "Default layout is changed.");
+
+    check(format(makeLogLayout<"%m">(), fields) == "hello\n", "Message only layout.");
+    check(format(makeLogLayout<"100%% [%l] %m%%">(), fields) == "100% [Info ] hello%\n", "Escaped '%' in layout.");
+    check(format(makeLogLayout<"">(), fields) == "\n", "Empty layout.");
+
+    // Truncated log line still ends with '\n'.
+    auto truncated = format(makeLogLayout<"%T %m">(), fields, 8);
+    check(truncated == "23.59.5\n", "Truncated log line: " + truncated);
+
+    std::cout << "[PASSED] test_layout" << std::endl;
+    return 0;
+}
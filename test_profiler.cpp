@@ -0,0 +1,68 @@
+#include "Profiler.h"
+#include "Error.h"
+#include "TestUtils.h"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace utils;
+using namespace utils::test;
+using namespace std::chrono_literals;
+
+static constexpr std::string_view PROFILE_PATH = "/tmp/cpp_utils_test_profiler.folded";
+
+// Exported by -rdynamic, so that it can be symbolized.
+extern "C" __attribute__((noinline)) double burnCpu(std::chrono::milliseconds duration) {
+    auto deadline = std::chrono::steady_clock::now() + duration;
+    double result = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+        for (int i = 0; i < 1000; ++i) {
+            result += std::sqrt(result + i);
+        }
+    }
+    return result;
+}
+
+int main() {
+    bool invalidFrequency = false;
+    try {
+        startProfiler(PROFILE_PATH, 0);
+    } catch (const NormalException& e) {
+        invalidFrequency = e.getErr() == ErrorCode::InvalidArgument;
+    }
+    check(invalidFrequency, "Invalid frequency is accepted.");
+
+    // Interval of 1 Hz is a whole second.
+    startProfiler(PROFILE_PATH, 1);
+    stopProfiler();
+
+    startProfiler(PROFILE_PATH, 1000);
+    bool restarted = true;
+    try {
+        startProfiler(PROFILE_PATH);
+    } catch (const NormalException&) {
+        restarted = false;
+    }
+    check(!restarted, "Profiler is started twice.");
+    burnCpu(500ms);
+    stopProfiler();
+
+    std::ifstream input { std::string(PROFILE_PATH) };
+    check(input.is_open(), "Folded stacks file isn't written.");
+    std::string line;
+    uint64_t burnSamples = 0;
+    while (std::getline(input, line)) {
+        auto space = line.rfind(' ');
+        check(space != std::string::npos, "Invalid folded stack: " + line);
+        if (line.find(";main;burnCpu") != std::string::npos) {
+            burnSamples += std::stoull(line.substr(space + 1));
+        }
+    }
+    check(burnSamples > 0, "burnCpu() isn't sampled.");
+    std::cout << "[PASSED] test_profiler" << std::endl;
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include "Log.h"
+#include "TestUtils.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <unistd.h>
+}
+
+// Built with small LOG_MAX_FILE_SIZE and LOG_MAX_TOTAL_SIZE, so that log files are rotated
+// many times in one second, and most of them are deleted by retention.
+
+using namespace utils;
+using namespace utils::test;
+
+static constexpr std::string_view TAG = "RotationTest";
+static constexpr int PROCESS_COUNT = 2;
+static constexpr int LINE_COUNT = 20000;
+
+static void writeLines() {
+    for (int i = 0; i < LINE_COUNT; ++i) {
+        LOG_INFO("rotation-test %d %d", static_cast<int>(::getpid()), i);
+    }
+}
+
+// Log file is named "date_time_pid_sequence.log".
+static int parseFilePid(const std::string& fileName) {
+    int pid = 0;
+    unsigned sequence = 0;
+    auto pos = fileName.find('_', fileName.find('_') + 1);
+    if (pos == std::string::npos || sscanf(fileName.c_str() + pos, "_%d_%u.log", &pid, &sequence) != 2) {
+        return -1;
+    }
+    return pid;
+}
+
+int main() {
+    TempDir logDir { DEFAULT_LOG_PATH };
+
+    // Processes wait for each other before exit, so that log files of one process are still in use
+    // while others are rotating. Retention may delete them after the process exits.
+    int donePipe[2];
+    int exitPipe[2];
+    check(::pipe(donePipe) == 0 && ::pipe(exitPipe) == 0, "pipe");
+    std::vector<pid_t> children;
+    for (int i = 0; i < PROCESS_COUNT; ++i) {
+        children.push_back(forkChild([&] {
+            ::close(exitPipe[1]);
+            writeLines();
+            char c = 0;
+            check(::write(donePipe[1], &c, 1) == 1, "notify done");
+            // Parent closes pipe to let all processes exit.
+            check(::read(exitPipe[0], &c, 1) == 0, "wait exit");
+        }));
+    }
+    ::close(exitPipe[0]);
+    for (int i = 0; i < PROCESS_COUNT; ++i) {
+        char c = 0;
+        check(::read(donePipe[0], &c, 1) == 1, "wait done");
+    }
+    ::close(exitPipe[1]);
+    for (auto pid: children) {
+        waitChildExit(pid);
+    }
+
+    // The count of every line of every process.
+    std::map<int, std::vector<int>> lineCounts;
+    for (auto pid: children) {
+        lineCounts[pid].resize(LINE_COUNT);
+    }
+    uintmax_t totalSize = 0;
+    for (const auto& entry: std::filesystem::directory_iterator(DEFAULT_LOG_PATH)) {
+        auto fileName = entry.path().filename().string();
+        check(!fileName.starts_with("."), "hidden next log file is renamed or removed: " + fileName);
+        check(entry.path().extension() == ".log", "only log files are created: " + fileName);
+        totalSize += entry.file_size();
+
+        // Processes never write to log file of each other.
+        auto filePid = parseFilePid(fileName);
+        check(lineCounts.count(filePid) == 1, "log file is named by pid: " + fileName);
+        std::ifstream input { entry.path() };
+        std::string line;
+        while (std::getline(input, line)) {
+            auto pos = line.find("rotation-test ");
+            check(pos != std::string::npos, "unexpected line: " + line);
+            int pid = 0;
+            int index = 0;
+            check(sscanf(line.c_str() + pos, "rotation-test %d %d", &pid, &index) == 2, "parse line: " + line);
+            check(pid == filePid, "line is written to log file of its process: " + fileName);
+            check(index >= 0 && index < LINE_COUNT, "line index is valid: " + line);
+            ++lineCounts[pid][index];
+        }
+    }
+    check(totalSize <= LOG_MAX_TOTAL_SIZE, "total size of log files is limited by LOG_MAX_TOTAL_SIZE");
+
+    // Retention deletes the oldest files, so the rest lines of every process is contiguous and
+    // ends with the last line, which is in the current log file.
+    for (auto& [pid, counts]: lineCounts) {
+        int first = LINE_COUNT;
+        while (first > 0 && counts[first - 1] > 0) {
+            --first;
+        }
+        check(first < LINE_COUNT, "current log file is never deleted");
+        check(first > 0, "old log files are deleted");
+        for (int i = 0; i < LINE_COUNT; ++i) {
+            check(counts[i] == (i >= first ? 1 : 0), "every line is written exactly once: " + std::to_string(i));
+        }
+    }
+    std::cout << "[PASSED] test_rotation" << std::endl;
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "Log.h"
+#include "Error.h"
+#include "LogCollector.h"
+#include "LogSink.h"
+#include "TestUtils.h"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace utils;
+using namespace utils::test;
+using namespace std::chrono_literals;
+
+static constexpr std::string_view TAG = "SinkTest";
+static constexpr std::string_view SINK_ADDRESS = "unix:/tmp/cpp_utils_test_sink.sock";
+static constexpr std::string_view SPILL_PATH = "/tmp/cpp_utils_test_sink.spill";
+
+// Receive frames until "count" log lines of test are received.
+static void receive(LogCollector& collector, std::string& received, int count) {
+    auto deadline = std::chrono::steady_clock::now() + 10s;
+    auto lineCount = [&] {
+        int result = 0;
+        for (size_t pos = received.find("sink-test "); pos != std::string::npos; pos = received.find("sink-test ", pos + 1)) {
+            ++result;
+        }
+        return result;
+    };
+    while (lineCount() < count && std::chrono::steady_clock::now() < deadline) {
+        collector.poll(100ms, [&] (std::string_view frame) {
+            received.append(frame);
+        });
+    }
+}
+
+static void writeLines(int begin, int end) {
+    for (int i = begin; i != end; ++i) {
+        LOG_INFO("sink-test %d", i);
+    }
+    // Use LOG_ERR to flush current buffer immediately.
+    LOG_ERR("flush sink");
+}
+
+int main() {
+    TempDir logDir { DEFAULT_LOG_PATH };
+
+    // Spill file is locked by its owner, so processes never share it.
+    {
+        auto spillFile = std::make_unique<detail::SpillFile>(std::string(SPILL_PATH), 4096);
+        bool locked = false;
+        try {
+            detail::SpillFile another { std::string(SPILL_PATH), 4096 };
+        } catch (const NormalException& e) {
+            locked = e.getErr() == ErrorCode::OpNotAllowed;
+        }
+        check(locked, "Spill file is not locked.");
+        spillFile.reset();
+        detail::SpillFile again { std::string(SPILL_PATH), 4096 };
+    }
+    std::filesystem::remove(SPILL_PATH);
+
+    std::string received;
+    auto collector = std::make_unique<LogCollector>(SINK_ADDRESS);
+    setLogSink(SINK_ADDRESS);
+
+    // Collector is online.
+    writeLines(0, 100);
+    receive(*collector, received, 100);
+
+    // Collector is offline, log lines are spilled to local file.
+    collector.reset();
+    writeLines(100, 200);
+    std::this_thread::sleep_for(500ms);
+
+    // Collector is online again, spilled log lines are replayed before new log lines.
+    collector = std::make_unique<LogCollector>(SINK_ADDRESS);
+    writeLines(200, 300);
+    receive(*collector, received, 300);
+
+    // Payload is expanded to dump lines before it's sent.
+    std::string_view payload = "hello";
+    LOG_INFO_B64(payload.data(), payload.size(), "sink-test %d", 300);
+    LOG_ERR("flush sink");
+    receive(*collector, received, 301);
+    check(received.find("sink-test 300\n    0000: aGVsbG8=\n") != std::string::npos, "Payload is not expanded.");
+
+    // Log line may contain '\0', it's kept as is, and never be taken as payload record.
+    constexpr std::string_view nulLine { "sink-test 301 \0 nul", 19 };
+    {
+        LogRecordGroup group { LogLevel::Info, TAG };
+        group.append(nulLine);
+    }
+    LOG_INFO_HEX(payload.data(), payload.size(), "sink-test %d", 302);
+    LOG_ERR("flush sink");
+    receive(*collector, received, 303);
+    check(received.find(std::string(nulLine) + "\n") != std::string::npos, "Log line with '\\0' is changed.");
+    check(received.find("sink-test 302\n    0000: 68656c6c6f\n") != std::string::npos, "Payload after '\\0' is not expanded.");
+
+    size_t pos = 0;
+    for (int i = 0; i != 300; ++i) {
+        auto line = "sink-test " + std::to_string(i) + "\n";
+        auto next = received.find(line, pos);
+        check(next != std::string::npos, "Log line is lost or out of order: " + line);
+        pos = next + line.size();
+    }
+    std::cout << "[PASSED] test_sink" << std::endl;
+    return 0;
+}
@@ -0,0 +1,262 @@
+#include "Log.h"
+#include "TestUtils.h"
+
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Built with small LOG_MAX_FILE_SIZE, so that trace events are rotated to many trace files.
+
+using namespace utils;
+using namespace utils::test;
+
+static constexpr int SPAN_COUNT = 1000;
+static constexpr int THREAD_COUNT = 4;
+
+// Fields of one trace event, numbers are kept as text.
+using TraceFields = std::map<std::string, std::string>;
+
+// Minimal JSON parser, which validates the whole document, and collects the fields of objects
+// in top level array.
+class JsonParser {
+public:
+    explicit JsonParser(std::string_view text) : mText(text), mPos(0) {}
+
+    bool parse(std::vector<TraceFields>& events) {
+        skipSpace();
+        if (!consume('[')) {
+            return false;
+        }
+        skipSpace();
+        if (!consume(']')) {
+            do {
+                skipSpace();
+                TraceFields fields;
+                if (!parseObject(&fields)) {
+                    return false;
+                }
+                events.push_back(std::move(fields));
+                skipSpace();
+            } while (consume(','));
+            if (!consume(']')) {
+                return false;
+            }
+        }
+        skipSpace();
+        return mPos == mText.size();
+    }
+
+private:
+    bool consume(char c) {
+        if (mPos < mText.size() && mText[mPos] == c) {
+            ++mPos;
+            return true;
+        }
+        return false;
+    }
+
+    void skipSpace() {
+        while (mPos < mText.size() && std::isspace(static_cast<unsigned char>(mText[mPos]))) {
+            ++mPos;
+        }
+    }
+
+    bool parseString(std::string& result) {
+        if (!consume('"')) {
+            return false;
+        }
+        while (mPos < mText.size() && mText[mPos] != '"') {
+            char c = mText[mPos++];
+            if (static_cast<unsigned char>(c) < 0x20) {
+                return false;
+            }
+            if (c == '\\') {
+                if (mPos == mText.size() || std::string_view("\"\\/bfnrtu").find(mText[mPos]) == std::string_view::npos) {
+                    return false;
+                }
+                c = mText[mPos++];
+                // Only ASCII is escaped by trace file.
+                if (c == 'u') {
+                    unsigned code = 0;
+                    if (mPos + 4 > mText.size() || sscanf(std::string(mText.substr(mPos, 4)).c_str(), "%4x", &code) != 1 || code > 0x7f) {
+                        return false;
+                    }
+                    mPos += 4;
+                    c = static_cast<char>(code);
+                }
+            }
+            result.push_back(c);
+        }
+        return consume('"');
+    }
+
+    bool parseNumber(std::string& result) {
+        auto begin = mPos;
+        consume('-');
+        while (mPos < mText.size() && (std::isdigit(static_cast<unsigned char>(mText[mPos]))
+                || std::string_view(".eE+-").find(mText[mPos]) != std::string_view::npos)) {
+            ++mPos;
+        }
+        result = mText.substr(begin, mPos - begin);
+        return !result.empty() && result != "-";
+    }
+
+    bool parseValue(std::string& result) {
+        skipSpace();
+        if (mPos == mText.size()) {
+            return false;
+        }
+        switch (mText[mPos]) {
+            case '"': return parseString(result);
+            case '{': return parseObject(nullptr);
+            case '[': {
+                ++mPos;
+                skipSpace();
+                if (consume(']')) {
+                    return true;
+                }
+                do {
+                    std::string item;
+                    if (!parseValue(item)) {
+                        return false;
+                    }
+                    skipSpace();
+                } while (consume(','));
+                return consume(']');
+            }
+            default:
+                for (std::string_view literal: { "true", "false", "null" }) {
+                    if (mText.substr(mPos, literal.size()) == literal) {
+                        mPos += literal.size();
+                        result = literal;
+                        return true;
+                    }
+                }
+                return parseNumber(result);
+        }
+    }
+
+    bool parseObject(TraceFields* fields) {
+        if (!consume('{')) {
+            return false;
+        }
+        skipSpace();
+        if (consume('}')) {
+            return true;
+        }
+        do {
+            skipSpace();
+            std::string key;
+            std::string value;
+            if (!parseString(key)) {
+                return false;
+            }
+            skipSpace();
+            if (!consume(':') || !parseValue(value)) {
+                return false;
+            }
+            if (fields != nullptr) {
+                (*fields)[key] = value;
+            }
+            skipSpace();
+        } while (consume(','));
+        return consume('}');
+    }
+
+    std::string_view    mText;
+    size_t              mPos;
+};
+
+static void writeSpans() {
+    for (int i = 0; i < SPAN_COUNT; ++i) {
+        LOG_SCOPE("unsampled");
+    }
+    setTraceSampleRate("sampled", 10);
+    for (int i = 0; i < SPAN_COUNT; ++i) {
+        LOG_SCOPE("sampled");
+    }
+    setTraceSampleRate("disabled", 0);
+    for (int i = 0; i < SPAN_COUNT; ++i) {
+        LOG_SCOPE("disabled");
+    }
+    // The counter of call site goes on after sample rate is changed.
+    for (int i = 0; i < 100; ++i) {
+        if (i == 50) {
+            setTraceSampleRate("changed", 5);
+        }
+        LOG_SCOPE("changed");
+    }
+    {
+        LOG_SCOPE("quote\"back\\slash");
+    }
+    {
+        LOG_SCOPE("tab\tname");
+    }
+    std::vector<std::thread> threads;
+    for (int i = 0; i < THREAD_COUNT; ++i) {
+        threads.emplace_back([] {
+            for (int j = 0; j < SPAN_COUNT; ++j) {
+                LOG_SCOPE("threaded");
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+}
+
+int main() {
+    TempDir logDir { DEFAULT_LOG_PATH };
+    // Trace files are completed when log server is destroyed, so write spans in child process.
+    auto pid = runChild(writeSpans);
+
+    std::vector<TraceFields> events;
+    int traceFileCount = 0;
+    const auto suffix = "_" + std::to_string(pid) + "_";
+    for (const auto& entry: std::filesystem::directory_iterator(DEFAULT_LOG_PATH)) {
+        auto fileName = entry.path().filename().string();
+        if (!fileName.ends_with(".trace.json")) {
+            continue;
+        }
+        ++traceFileCount;
+        check(fileName.find(suffix) != std::string::npos, "trace file is named by pid and sequence: " + fileName);
+        check(entry.file_size() <= LOG_MAX_FILE_SIZE, "trace file is rotated at LOG_MAX_FILE_SIZE: " + fileName);
+        std::ifstream input { entry.path() };
+        std::stringstream text;
+        text << input.rdbuf();
+        check(JsonParser(text.str()).parse(events), "trace file is valid JSON: " + fileName);
+    }
+    check(traceFileCount > 1, "trace file is rotated");
+
+    std::map<std::string, int> counts;
+    std::set<std::string> threadIds;
+    for (auto& event: events) {
+        check(event["ph"] == "X", "event is complete event");
+        check(std::stoll(event["dur"]) >= 0, "duration isn't negative");
+        check(event["pid"] == std::to_string(pid), "pid of event");
+        ++counts[event["name"]];
+        if (event["name"] == "threaded") {
+            threadIds.insert(event["tid"]);
+        }
+    }
+    check(counts["unsampled"] == SPAN_COUNT, "all spans are recorded by default");
+    check(counts["sampled"] == SPAN_COUNT / 10, "one of 10 spans is recorded");
+    check(counts.count("disabled") == 0, "rate 0 disables spans");
+    check(counts["changed"] == 50 + 10, "new sample rate takes effect at once");
+    check(counts["quote\"back\\slash"] == 1, "name is escaped");
+    check(counts["tab\tname"] == 1, "control character of name is escaped");
+    check(counts["threaded"] == THREAD_COUNT * SPAN_COUNT, "spans of all threads are recorded");
+    check(threadIds.size() == THREAD_COUNT, "spans are recorded with their tid");
+    check(events.size() == static_cast<size_t>(SPAN_COUNT + SPAN_COUNT / 10 + 60 + 2 + THREAD_COUNT * SPAN_COUNT)
+            , "no unexpected event");
+    std::cout << "[PASSED] test_trace" << std::endl;
+    return 0;
+}